@@ -0,0 +1,440 @@
+/**********************************************************************************
+ *
+ * FILE:            bench.cpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Comparative benchmark of the customer threads of the ETS against the naive
+ * strategies described in main.cpp, on the same generated traces.
+ *
+ * Every engine keeps, for each customer, the first and the last event of each of
+ * its packages, ordered by the last one, and the whole event sequence of each
+ * package. They differ in how the outdated last event leaves the customer thread:
+ *
+ * - vector: a std::vector per customer; the old event is searched and erased,
+ *   shifting everything after it.
+ * - list: a std::list per customer, with the iterators of the last event of each
+ *   package kept by package, so the old event is erased in constant time.
+ * - ets: the DimensionNode, LinkedList, NodePool and Hash of the project, updated
+ *   by the very updateCustomerList and updatePackageList main.cpp runs
+ *   (see thread_update.hpp), so a regression there shows here too.
+ *
+ * The traces register a fixed number of packages whose events arrive in random
+ * order, and query a random customer every QUERY_INTERVAL commands. As the number
+ * of packages per customer grows, so do the customer threads. For each engine the
+ * benchmark reports the throughput (commands per second) and the peak heap bytes,
+ * counted by replacing the global operator new and delete. The answers of every
+ * engine are checked against each other.
+ *
+ * Usage: bench [packages] [events per package]   (built by make bench)
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#include "hash.hpp"
+#include "dimension_node.hpp"
+#include "linked_list.hpp"
+#include "node_pool.hpp"
+#include "thread_update.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+
+
+
+
+// Heap bytes currently allocated and the highest value since the last reset
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+
+
+
+void* operator new(size_t size) {
+    void* block = malloc(size > 0 ? size : 1);
+    if (block == nullptr) throw std::bad_alloc();
+    liveBytes += malloc_usable_size(block);
+    if (liveBytes > peakBytes) peakBytes = liveBytes;
+    return block;
+}
+
+
+
+// The blocks of this operator delete do come from malloc, in operator new above
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* block) noexcept {
+    if (block == nullptr) return;
+    liveBytes -= malloc_usable_size(block);
+    free(block);
+}
+#pragma GCC diagnostic pop
+
+
+
+void operator delete(void* block, size_t) noexcept {
+    operator delete(block);
+}
+
+
+
+
+// A command of the generated traces
+struct BenchCommand {
+    enum Type { REGISTER, EVENT, QUERY } type;
+    int packageId;
+    int sender;
+    int recipient;
+};
+
+
+
+const int QUERY_INTERVAL = 10;
+
+
+
+
+class Engine
+{
+    public:
+        virtual ~Engine() = default;
+
+        virtual void registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) = 0;
+        virtual void addEvent(int packageId, int i) = 0;
+        // Replaces out with the customer thread: command indexes, in thread order
+        virtual void customerThread(const std::string& customer, std::vector<int>& out) = 0;
+};
+
+
+
+
+class VectorEngine : public Engine
+{
+    private:
+        struct Package {
+            std::string sender;
+            std::string recipient;
+            std::vector<int> events;
+        };
+        std::unordered_map<std::string, std::vector<int>> _customers;
+        std::unordered_map<int, Package> _packages;
+
+        static void replace(std::vector<int>& thread, int oldItem, int newItem);
+
+    public:
+        void registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) override;
+        void addEvent(int packageId, int i) override;
+        void customerThread(const std::string& customer, std::vector<int>& out) override;
+};
+
+
+
+
+void VectorEngine::registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) {
+    Package& package = _packages[packageId];
+    package.sender = sender;
+    package.recipient = recipient;
+    package.events.push_back(i);
+    _customers[sender].push_back(i);
+    _customers[recipient].push_back(i);
+}
+
+
+
+// The first event of a package never leaves the thread; a later one is replaced
+void VectorEngine::replace(std::vector<int>& thread, int oldItem, int newItem) {
+    if (oldItem >= 0) thread.erase(std::find(thread.begin(), thread.end(), oldItem));
+    thread.push_back(newItem);
+}
+
+
+
+
+void VectorEngine::addEvent(int packageId, int i) {
+    Package& package = _packages[packageId];
+    int oldItem = (package.events.size() >= 2) ? package.events.back() : -1;
+    replace(_customers[package.sender], oldItem, i);
+    replace(_customers[package.recipient], oldItem, i);
+    package.events.push_back(i);
+}
+
+
+
+
+void VectorEngine::customerThread(const std::string& customer, std::vector<int>& out) {
+    auto found = _customers.find(customer);
+    out.clear();
+    if (found != _customers.end()) out = found->second;
+}
+
+
+
+
+class ListEngine : public Engine
+{
+    private:
+        struct Package {
+            std::string sender;
+            std::string recipient;
+            std::vector<int> events;
+            // Last event of the package in each customer thread
+            std::list<int>::iterator senderLast;
+            std::list<int>::iterator recipientLast;
+        };
+        std::unordered_map<std::string, std::list<int>> _customers;
+        std::unordered_map<int, Package> _packages;
+
+    public:
+        void registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) override;
+        void addEvent(int packageId, int i) override;
+        void customerThread(const std::string& customer, std::vector<int>& out) override;
+};
+
+
+
+
+void ListEngine::registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) {
+    Package& package = _packages[packageId];
+    package.sender = sender;
+    package.recipient = recipient;
+    package.events.push_back(i);
+    std::list<int>& senderThread = _customers[sender];
+    std::list<int>& recipientThread = _customers[recipient];
+    package.senderLast = senderThread.insert(senderThread.end(), i);
+    package.recipientLast = recipientThread.insert(recipientThread.end(), i);
+}
+
+
+
+
+void ListEngine::addEvent(int packageId, int i) {
+    Package& package = _packages[packageId];
+    std::list<int>& senderThread = _customers[package.sender];
+    std::list<int>& recipientThread = _customers[package.recipient];
+    if (package.events.size() >= 2) {
+        senderThread.erase(package.senderLast);
+        recipientThread.erase(package.recipientLast);
+    }
+    package.senderLast = senderThread.insert(senderThread.end(), i);
+    package.recipientLast = recipientThread.insert(recipientThread.end(), i);
+    package.events.push_back(i);
+}
+
+
+
+
+void ListEngine::customerThread(const std::string& customer, std::vector<int>& out) {
+    out.clear();
+    auto found = _customers.find(customer);
+    if (found == _customers.end()) return;
+    for (int item : found->second) out.push_back(item);
+}
+
+
+
+
+class EtsEngine : public Engine
+{
+    private:
+        // The hashes of the names are kept as main.cpp keeps them for its stakeholders
+        struct Package {
+            std::string sender;
+            std::string recipient;
+            size_t senderHash = 0;
+            size_t recipientHash = 0;
+            LinkedList<int> events;
+        };
+        Hash<std::string, LinkedList<int>> _customers;
+        Hash<int, Package> _packages;
+        NodePool<int> _nodes;
+
+    public:
+        EtsEngine() : _customers(1000), _packages(1000) {};
+
+        void registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) override;
+        void addEvent(int packageId, int i) override;
+        void customerThread(const std::string& customer, std::vector<int>& out) override;
+};
+
+
+
+
+void EtsEngine::registerPackage(int packageId, const std::string& sender, const std::string& recipient, int i) {
+    Package* package = &_packages[packageId];
+    package->sender = sender;
+    package->recipient = recipient;
+    package->senderHash = _customers.hashOf(sender);
+    package->recipientHash = _customers.hashOf(recipient);
+
+    DimensionNode<int>* newDNode = _nodes.allocate();
+    newDNode->item = i;
+    updateCustomerList(sender, package->senderHash, nullptr, newDNode, newDNode, &_customers.get(sender, package->senderHash));
+    updateCustomerList(recipient, package->recipientHash, nullptr, newDNode, newDNode, &_customers.get(recipient, package->recipientHash));
+    updatePackageList(&package->events, newDNode);
+}
+
+
+
+
+void EtsEngine::addEvent(int packageId, int i) {
+    Package* package = &_packages[packageId];
+    DimensionNode<int>* DNode = package->events.tail;
+    DimensionNode<int>* newDNode = _nodes.allocate();
+    newDNode->item = i;
+
+    // Both customers entered with the registration, the first node of the package
+    updateCustomerList(package->sender, package->senderHash, DNode, newDNode, package->events.head,
+                       &_customers.get(package->sender, package->senderHash));
+    updateCustomerList(package->recipient, package->recipientHash, DNode, newDNode, package->events.head,
+                       &_customers.get(package->recipient, package->recipientHash));
+    updatePackageList(&package->events, newDNode);
+}
+
+
+
+void EtsEngine::customerThread(const std::string& customer, std::vector<int>& out) {
+    out.clear();
+    const LinkedList<int>* thread = _customers.find(customer);
+    if (thread == nullptr) return;
+    for (const DimensionNode<int>* DNode = thread->head; DNode != nullptr; DNode = DNode->next(customer))
+        out.push_back(DNode->item);
+}
+
+
+
+
+/* Every package gets eventsPerPackage events (its registration included), in a
+*  random interleaving, with sender and recipient drawn among the customers so
+*  that each customer takes part in about packagesPerCustomer packages.
+*/
+std::vector<BenchCommand> generateTrace(int packages, int eventsPerPackage, int packagesPerCustomer, int& customers) {
+    std::mt19937 random(42);
+    customers = std::max(2, 2 * packages / packagesPerCustomer);
+    std::uniform_int_distribution<int> customer(0, customers - 1);
+
+    std::vector<int> order;
+    for (int packageId = 0; packageId < packages; packageId++)
+        order.insert(order.end(), eventsPerPackage, packageId);
+    std::shuffle(order.begin(), order.end(), random);
+
+    std::vector<BenchCommand> trace;
+    std::vector<char> registered(packages, 0);
+    for (int packageId : order) {
+        if (trace.size() % QUERY_INTERVAL == QUERY_INTERVAL - 1)
+            trace.push_back({ BenchCommand::QUERY, 0, customer(random), 0 });
+
+        if (registered[packageId]) {
+            trace.push_back({ BenchCommand::EVENT, packageId, 0, 0 });
+            continue;
+        }
+        registered[packageId] = 1;
+        int sender = customer(random);
+        int recipient = customer(random);
+        if (recipient == sender) recipient = (sender + 1) % customers;
+        trace.push_back({ BenchCommand::REGISTER, packageId, sender, recipient });
+    }
+    return trace;
+}
+
+
+
+// Runs the trace on a new engine; returns the seconds taken and folds every answer into checksum
+double runEngine(int engine, const std::vector<BenchCommand>& trace, const std::vector<std::string>& names, size_t& peak, unsigned long& checksum) {
+    std::vector<int> answer;
+    answer.reserve(1024);
+    size_t baseline = liveBytes;
+    peakBytes = liveBytes;
+    checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        Engine* ets = (engine == 0) ? static_cast<Engine*>(new VectorEngine())
+                    : (engine == 1) ? static_cast<Engine*>(new ListEngine())
+                    : static_cast<Engine*>(new EtsEngine());
+        for (size_t i = 0; i < trace.size(); i++) {
+            const BenchCommand& command = trace[i];
+            switch (command.type) {
+                case BenchCommand::REGISTER:
+                    ets->registerPackage(command.packageId, names[command.sender], names[command.recipient], i);
+                    break;
+                case BenchCommand::EVENT:
+                    ets->addEvent(command.packageId, i);
+                    break;
+                case BenchCommand::QUERY:
+                    ets->customerThread(names[command.sender], answer);
+                    for (int item : answer) checksum = checksum * 31 + item;
+                    checksum = checksum * 31 + answer.size();
+                    break;
+            }
+        }
+        peak = peakBytes - baseline;
+        delete ets;
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+};
+
+
+
+
+int main(int argc, char* argv[]) {
+    int packages = (argc > 1) ? atoi(argv[1]) : 20000;
+    int eventsPerPackage = (argc > 2) ? atoi(argv[2]) : 6;
+    if (packages < 1 || eventsPerPackage < 1) {
+        std::cerr << "Usage: " << argv[0] << " [packages] [events per package]" << std::endl;
+        return 1;
+    }
+
+    const char* engines[3] = { "vector", "list", "ets" };
+    const int loads[5] = { 4, 16, 64, 256, 1024 };
+
+    std::cout << std::left << std::setw(12) << "pkg/cust" << std::setw(10) << "engine" << std::right
+              << std::setw(12) << "commands" << std::setw(14) << "Mcmd/s" << std::setw(14) << "peak MiB" << '\n';
+    for (int load : loads) {
+        int customers;
+        std::vector<BenchCommand> trace = generateTrace(packages, eventsPerPackage, load, customers);
+        std::vector<std::string> names;
+        for (int k = 0; k < customers; k++) names.push_back("customer" + std::to_string(k));
+
+        unsigned long expected = 0;
+        for (int engine = 0; engine < 3; engine++) {
+            size_t peak;
+            unsigned long checksum;
+            double seconds = runEngine(engine, trace, names, peak, checksum);
+            if (engine == 0) expected = checksum;
+
+            std::cout << std::left << std::setw(12) << load << std::setw(10) << engines[engine] << std::right
+                      << std::setw(12) << trace.size() << std::setw(14) << std::fixed << std::setprecision(3) << trace.size() / seconds / 1e6
+                      << std::setw(14) << std::setprecision(2) << peak / 1048576.0 << '\n';
+            if (checksum != expected) {
+                std::cerr << "Error: the " << engines[engine] << " engine disagrees with the vector engine" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
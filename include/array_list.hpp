@@ -5,20 +5,38 @@
 #include "utils.hpp"
 
 
-#include <iostream>  
+#include <iostream>
 #include <stdexcept>
+#include <new>
+#include <cstring>
+#include <utility>
+#include <type_traits>
 
 
 
 
+/* Vetor dinâmico sobre memória bruta: a capacidade é reservada sem construir nada
+*  e só as posições [0, _size) guardam objetos vivos, construídos no lugar
+*  (placement new) e destruídos ao sair do vetor. Tipos trivialmente copiáveis
+*  são copiados e realocados com memcpy.
+*/
 template <typename T>
-class ArrayList 
+class ArrayList
 {
     private:
-        int _size;   
+        int _size;
         int _maxSize;
-        T* _items;    
-        
+        T* _items;
+
+        static const bool _trivial = std::is_trivially_copyable<T>::value;
+
+        static T* allocate(int capacity);
+        static void deallocate(T* items);
+        // Move count objetos de from para a memória bruta de to, destruindo os de from
+        static void relocate(T* from, T* to, int count);
+        void destroy(int begin, int end);
+        int grownCapacity() const;
+
         void swap(ArrayList<T>& other);
 
     public:
@@ -43,29 +61,92 @@ class ArrayList
         void setItem(const T& item, int pos);
         void setItem(T&& item, int pos);
         void insertAtEnd(const T& item);
+        void insertAtEnd(T&& item);
         void insertAtPosition(const T& item, int pos);
         T removeFromPosition(int pos);
 
-        // Operador de Acesso
+        // Constrói o item no fim do vetor com os argumentos do seu construtor
+        template <typename... Args>
+        T& emplace_back(Args&&... args);
+
+        // Operador de Acesso (apenas posições ocupadas)
         T& operator[](int index);
         const T& operator[](int index) const;
 
         // Utilitários
+        // resize troca a capacidade (descartando o que não couber); reserve apenas a aumenta
         void resize(int newSize);
+        void reserve(int capacity);
+        // Substitui o conteúdo por count cópias de value
+        void assign(int count, const T& value);
         int search(const T& key) const;
         void clear();
+
+        // Memória do vetor e do que os elementos alocam; shrinkToFit reduz a capacidade ao tamanho
+        MemoryUsage memoryUsage() const;
+        void shrinkToFit();
 };
 
 
 
 
+template <typename T>
+T* ArrayList<T>::allocate(int capacity) {
+    if (capacity == 0) return nullptr;
+    return static_cast<T*>(::operator new(sizeof(T) * capacity));
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::deallocate(T* items) {
+    ::operator delete(items);
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::relocate(T* from, T* to, int count) {
+    if (count == 0) return;
+    if (_trivial) {
+        memcpy(static_cast<void*>(to), static_cast<const void*>(from), sizeof(T) * count);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        new (to + i) T(my_move(from[i]));
+        from[i].~T();
+    }
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::destroy(int begin, int end) {
+    if (std::is_trivially_destructible<T>::value) return;
+    for (int i = begin; i < end; i++)
+        _items[i].~T();
+}
+
+
+
+
+template <typename T>
+int ArrayList<T>::grownCapacity() const {
+    return (_maxSize > 0) ? (_maxSize * 2) : 10;
+}
+
+
+
 // Construtores padrão
 template <typename T>
-ArrayList<T>::ArrayList() : _size(0), _maxSize(10), _items(new T[10]) {}
+ArrayList<T>::ArrayList() : _size(0), _maxSize(10), _items(allocate(10)) {}
 
 
 
-// Construtor com tamanho
+// Construtor com tamanho: apenas reserva a memória
 template <typename T>
 ArrayList<T>::ArrayList(int maxSize) {
     if (maxSize < 0) {
@@ -73,7 +154,7 @@ ArrayList<T>::ArrayList(int maxSize) {
     }
     _maxSize = maxSize;
     _size = 0;
-    _items = (maxSize > 0) ? new T[_maxSize] : nullptr;
+    _items = allocate(maxSize);
 }
 
 
@@ -81,9 +162,13 @@ ArrayList<T>::ArrayList(int maxSize) {
 // Construtor de cópia
 template <typename T>
 ArrayList<T>::ArrayList(const ArrayList<T>& other) : _size(other._size), _maxSize(other._maxSize) {
-    _items = (other._maxSize > 0) ? new T[other._maxSize] : nullptr;
+    _items = allocate(other._maxSize);
+    if (_trivial) {
+        if (_size > 0) memcpy(static_cast<void*>(_items), static_cast<const void*>(other._items), sizeof(T) * _size);
+        return;
+    }
     for (int i = 0; i < _size; i++) {
-        _items[i] = other._items[i];
+        new (_items + i) T(other._items[i]);
     }
 }
 
@@ -93,8 +178,8 @@ ArrayList<T>::ArrayList(const ArrayList<T>& other) : _size(other._size), _maxSiz
 template <typename T>
 ArrayList<T>::ArrayList(ArrayList<T>&& other) noexcept
     : _size(other._size), _maxSize(other._maxSize), _items(other._items) {
-    other._items = nullptr; 
-    other._size = 0;     
+    other._items = nullptr;
+    other._size = 0;
     other._maxSize = 0;
 }
 
@@ -103,7 +188,8 @@ ArrayList<T>::ArrayList(ArrayList<T>&& other) noexcept
 
 template <typename T>
 ArrayList<T>::~ArrayList() {
-    delete[] _items;
+    destroy(0, _size);
+    deallocate(_items);
 }
 
 
@@ -174,10 +260,12 @@ template <typename T>
 void ArrayList<T>::setItem(const T& item, int pos) {
     if (pos < 0 || pos > _size || pos >= _maxSize)
     throw std::out_of_range("Invalid position: setItem (copy)");
-    
-    _items[pos] = item;
+
     if (pos == _size) {
+        new (_items + pos) T(item);
         _size++;
+    } else {
+        _items[pos] = item;
     }
 }
 
@@ -188,23 +276,51 @@ template <typename T>
 void ArrayList<T>::setItem(T&& item, int pos) {
     if (pos < 0 || pos > _size || pos >= _maxSize)
         throw std::out_of_range("Invalid position: setItem (move)");
-    
-    _items[pos] = my_move(item); 
+
     if (pos == _size) {
+        new (_items + pos) T(my_move(item));
         _size++;
+    } else {
+        _items[pos] = my_move(item);
     }
 }
 
 
 
-
+/* Ao crescer, o item é construído na memória nova antes de os antigos serem
+*  movidos para ela: os argumentos podem ser referências a um deles.
+*/
 template <typename T>
-void ArrayList<T>::insertAtEnd(const T& item) {
+template <typename... Args>
+T& ArrayList<T>::emplace_back(Args&&... args) {
     if (_size == _maxSize) {
-        int newCapacity = (_maxSize > 0) ? (_maxSize * 2) : 10; 
-        this->resize(newCapacity);
+        int newCapacity = grownCapacity();
+        T* new_items = allocate(newCapacity);
+        new (new_items + _size) T(std::forward<Args>(args)...);
+        relocate(_items, new_items, _size);
+        deallocate(_items);
+        _items = new_items;
+        _maxSize = newCapacity;
+    } else {
+        new (_items + _size) T(std::forward<Args>(args)...);
     }
-    _items[_size++] = item;
+    return _items[_size++];
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::insertAtEnd(const T& item) {
+    emplace_back(item);
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::insertAtEnd(T&& item) {
+    emplace_back(my_move(item));
 }
 
 
@@ -212,16 +328,19 @@ void ArrayList<T>::insertAtEnd(const T& item) {
 
 template <typename T>
 void ArrayList<T>::insertAtPosition(const T& item, int pos) {
-    if (_size == _maxSize)
-        this->resize(this->getSize() * 2);
     if (pos < 0 || pos > _size)
         throw std::out_of_range("Invalid position insertAtPosition");
+    if (pos == _size) {
+        emplace_back(item);
+        return;
+    }
 
-    for (int i = _size; i > pos; i--)
-        _items[i] = _items[i - 1];
-
-    _items[pos] = item;
-    _size++;
+    // Cópia antes de deslocar: o item pode ser um dos elementos do vetor
+    T copy(item);
+    emplace_back(my_move(_items[_size - 1]));
+    for (int i = _size - 2; i > pos; i--)
+        _items[i] = my_move(_items[i - 1]);
+    _items[pos] = my_move(copy);
 }
 
 
@@ -231,11 +350,12 @@ template <typename T>
 T ArrayList<T>::removeFromPosition(int pos) {
     if (pos < 0 || pos >= _size)
         throw std::out_of_range("Invalid position removeFromPosition");
-    
+
     T temp = my_move(_items[pos]);
     for (int i = pos; i < _size - 1; i++)
     _items[i] = my_move(_items[i + 1]);
     _size--;
+    _items[_size].~T();
     return temp;
 }
 
@@ -244,8 +364,8 @@ T ArrayList<T>::removeFromPosition(int pos) {
 
 template <typename T>
 T& ArrayList<T>::operator[](int index) {
-    if (index < 0 || index >= _maxSize) {
-        throw std::out_of_range("Invalid index: operator[] is out of capacity.");
+    if (index < 0 || index >= _size) {
+        throw std::out_of_range("Invalid index: operator[] is out of size.");
     }
     return _items[index];
 }
@@ -255,8 +375,8 @@ T& ArrayList<T>::operator[](int index) {
 
 template <typename T>
 const T& ArrayList<T>::operator[](int index) const {
-    if (index < 0 || index >= _maxSize) {
-        throw std::out_of_range("Invalid index: const operator[] is out of capacity.");
+    if (index < 0 || index >= _size) {
+        throw std::out_of_range("Invalid index: const operator[] is out of size.");
     }
     return _items[index];
 }
@@ -273,16 +393,34 @@ void ArrayList<T>::resize(int newSize) {
         return;
     }
 
-    T* new_items = (newSize > 0) ? new T[newSize] : nullptr;
     int limit = (newSize < _size) ? newSize : _size;
-    for (int i = 0; i < limit; i++) {
-        new_items[i] = my_move(_items[i]);
-    }
-    delete[] _items;
+    destroy(limit, _size);
+    T* new_items = allocate(newSize);
+    relocate(_items, new_items, limit);
+    deallocate(_items);
     _items = new_items;
     _maxSize = newSize;
-    if (_size > newSize)
-        _size = newSize;
+    _size = limit;
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::reserve(int capacity) {
+    if (capacity > _maxSize) this->resize(capacity);
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::assign(int count, const T& value) {
+    this->clear();
+    this->reserve(count);
+    for (int i = 0; i < count; i++)
+        new (_items + i) T(value);
+    _size = count;
 }
 
 
@@ -291,7 +429,7 @@ void ArrayList<T>::resize(int newSize) {
 template <typename T>
 int ArrayList<T>::search(const T& key) const {
     for (int i = 0; i < _size; i++) {
-        if (_items[i] == key) 
+        if (_items[i] == key)
             return i;
     }
     return -1;
@@ -299,15 +437,42 @@ int ArrayList<T>::search(const T& key) const {
 
 
 
-
+// Destrói os elementos, mantendo a capacidade
 template <typename T>
 void ArrayList<T>::clear() {
+    destroy(0, _size);
     _size = 0;
 }
 
 
 
 
+template <typename T>
+MemoryUsage ArrayList<T>::memoryUsage() const {
+    MemoryUsage usage;
+    usage.bytes = _maxSize * sizeof(T);
+    usage.usedBytes = _size * sizeof(T);
+    // Tipos trivialmente copiáveis não alocam nada fora de si: o vetor não é percorrido
+    if (_trivial) return usage;
+    for (int i = 0; i < _size; i++) {
+        size_t bytes = heapBytes(_items[i]);
+        usage.bytes += bytes;
+        usage.usedBytes += bytes;
+    }
+    return usage;
+}
+
+
+
+
+template <typename T>
+void ArrayList<T>::shrinkToFit() {
+    this->resize(_size);
+}
+
+
+
+
 template <typename T>
 ArrayList<T>& ArrayList<T>::operator=(const ArrayList<T>& other) {
     if (this != &other) {
@@ -323,12 +488,13 @@ ArrayList<T>& ArrayList<T>::operator=(const ArrayList<T>& other) {
 template <typename T>
 ArrayList<T>& ArrayList<T>::operator=(ArrayList<T>&& other) noexcept {
     if (this != &other) {
-        delete[] _items; 
+        destroy(0, _size);
+        deallocate(_items);
         _size = other._size;
         _maxSize = other._maxSize;
         _items = other._items;
-        other._items = nullptr; 
-        other._size = 0;       
+        other._items = nullptr;
+        other._size = 0;
         other._maxSize = 0;
     }
     return *this;
@@ -337,4 +503,4 @@ ArrayList<T>& ArrayList<T>::operator=(ArrayList<T>&& other) noexcept {
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,306 @@
+/**********************************************************************************
+ *
+ * FILE:            command_scheduler.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Priority scheduling of the server mode: queries are answered ahead of the
+ * events that are still queued, instead of waiting for a whole burst of them.
+ *
+ * The loop thread of the server parses every line. Events go to a queue drained
+ * by the event thread, which applies them in order, holding the state in turns.
+ * A query is answered right away on the loop thread. It takes the state through a
+ * SchedulerPriority, and the event thread gives the state up at the end of its
+ * current turn. The query sees the events applied up to that point, a prefix of
+ * the event stream, and is logged there, so replaying the log reproduces its
+ * answer.
+ *
+ * The latency target sets the length of a turn: while a query waits, the event
+ * thread keeps the state for at most 1/SCHEDULER_TURN_SHARE of the target since
+ * it last took it (plus the command under way), and yields after the command that
+ * crosses that point. A shorter target answers the queries sooner at the cost of
+ * more turns given up; a target of 0 yields after every command a query waits on.
+ * The event thread only reads the clock when a query is waiting.
+ *
+ * A query from a client whose earlier lines are still queued joins the queue
+ * instead. It is answered in its place, after the events of that client, and its
+ * answer is posted back to the server in order.
+ *
+ * The metrics cover the queue depth, the latency of the queries (from the line
+ * being parsed to its answer) against the latency target, and the turns the event
+ * thread gave up.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef COMMAND_SCHEDULER_HPP
+#define COMMAND_SCHEDULER_HPP
+
+#include "array_list.hpp"
+#include "trace_reader.hpp"
+#include "unix_server.hpp"
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+
+
+
+
+// Share of the latency target a turn lasts for, leaving the rest to the query itself
+const int SCHEDULER_TURN_SHARE = 4;
+
+
+
+using SchedulerClock = std::chrono::steady_clock;
+
+
+
+// A line waiting for the event thread, with the client its answer goes to
+struct ScheduledCommand {
+    Command command;
+    UnixServer::Client client;
+    SchedulerClock::time_point issued;
+    // Answer of a line that could not be parsed, kept in its place among the others
+    std::string error;
+};
+
+
+
+struct SchedulerMetrics {
+    long applied = 0;
+    long directQueries = 0;
+    long queuedQueries = 0;
+    long overTarget = 0;
+    uint64_t latencyTotal = 0;
+    uint64_t latencyMax = 0;
+    long yields = 0;
+    int depthMax = 0;
+    uint64_t depthTotal = 0;
+    long depthSamples = 0;
+};
+
+
+
+
+class CommandScheduler
+{
+    public:
+        // Applies a queued line to the state, appending its answer to out
+        using Applier = std::function<void(const ScheduledCommand& job, std::string& out)>;
+        // Hands the answer of a queued line back to its client
+        using Completion = std::function<void(const UnixServer::Client& client, const std::string& answer)>;
+
+    private:
+        // Guards the state; _waiting counts the queries about to take it
+        std::mutex _state;
+        std::atomic<int> _waiting;
+        std::mutex _queueMutex;
+        std::condition_variable _queueChanged;
+        ArrayList<ScheduledCommand> _queue;
+        // Lines queued and not applied yet
+        int _depth;
+        bool _stop;
+        std::thread _worker;
+        Applier _apply;
+        Completion _complete;
+        uint64_t _latencyTarget;
+        SchedulerClock::duration _turnLength;
+        // Query and turn counters are kept under _state, the depth ones under _queueMutex
+        SchedulerMetrics _metrics;
+
+        void work();
+        void yield(std::unique_lock<std::mutex>& state);
+
+        friend class SchedulerPriority;
+
+    public:
+        explicit CommandScheduler(int latencyTargetMicroseconds);
+        ~CommandScheduler();
+        CommandScheduler(const CommandScheduler& other) = delete;
+        CommandScheduler& operator=(const CommandScheduler& other) = delete;
+
+        void start(const Applier& apply, const Completion& complete);
+        void submit(const ScheduledCommand& job);
+        // Applies whatever is still queued, then stops the event thread
+        void stop();
+
+        // Counts a query answered now; the caller holds the state
+        void recordQuery(SchedulerClock::time_point issued, bool queued);
+        // Only meaningful once stopped
+        const SchedulerMetrics& metrics() const { return _metrics; };
+};
+
+
+
+// Holds the state for a query, ahead of the event thread
+class SchedulerPriority
+{
+    private:
+        CommandScheduler& _scheduler;
+
+    public:
+        explicit SchedulerPriority(CommandScheduler& scheduler);
+        ~SchedulerPriority();
+        SchedulerPriority(const SchedulerPriority& other) = delete;
+        SchedulerPriority& operator=(const SchedulerPriority& other) = delete;
+};
+
+
+
+
+CommandScheduler::CommandScheduler(int latencyTargetMicroseconds)
+    : _waiting(0), _queue(1024), _depth(0), _stop(false),
+      _latencyTarget(static_cast<uint64_t>(latencyTargetMicroseconds) * 1000),
+      _turnLength(std::chrono::microseconds(latencyTargetMicroseconds) / SCHEDULER_TURN_SHARE) {}
+
+
+
+
+CommandScheduler::~CommandScheduler() {
+    stop();
+}
+
+
+
+
+void CommandScheduler::start(const Applier& apply, const Completion& complete) {
+    _apply = apply;
+    _complete = complete;
+    _worker = std::thread(&CommandScheduler::work, this);
+}
+
+
+
+
+void CommandScheduler::submit(const ScheduledCommand& job) {
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    _queue.insertAtEnd(job);
+    _depth++;
+
+    if (_depth > _metrics.depthMax) _metrics.depthMax = _depth;
+    _metrics.depthTotal += _depth;
+    _metrics.depthSamples++;
+    _queueChanged.notify_one();
+}
+
+
+
+
+void CommandScheduler::stop() {
+    if (!_worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _stop = true;
+        _queueChanged.notify_one();
+    }
+    _worker.join();
+}
+
+
+
+
+/* Event thread: takes the whole queue at once and applies it in turns. A turn
+*  ends once a query waits and the turn has lasted _turnLength; the state is then
+*  given up to the waiting queries.
+*/
+void CommandScheduler::work() {
+    ArrayList<ScheduledCommand> batch(1024);
+    std::string out;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _queueChanged.wait(lock, [&] { return _stop || !_queue.isEmpty(); });
+            if (_queue.isEmpty()) return;
+            std::swap(batch, _queue);
+        }
+
+        std::unique_lock<std::mutex> state(_state);
+        SchedulerClock::time_point turn = SchedulerClock::now();
+        for (int k = 0; k < batch.getSize(); k++) {
+            if (_waiting.load(std::memory_order_acquire) > 0 && SchedulerClock::now() - turn >= _turnLength) {
+                yield(state);
+                turn = SchedulerClock::now();
+            }
+
+            const ScheduledCommand& job = batch[k];
+            _apply(job, out);
+            _metrics.applied++;
+            if (job.error.empty() && !job.command.isEvent()) recordQuery(job.issued, true);
+            _complete(job.client, out);
+            out.clear();
+        }
+        state.unlock();
+
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _depth -= batch.getSize();
+        }
+        batch.clear();
+    }
+}
+
+
+
+
+// Lets the waiting queries through before taking the state back
+void CommandScheduler::yield(std::unique_lock<std::mutex>& state) {
+    _metrics.yields++;
+    state.unlock();
+    while (_waiting.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+    state.lock();
+}
+
+
+
+
+void CommandScheduler::recordQuery(SchedulerClock::time_point issued, bool queued) {
+    uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(SchedulerClock::now() - issued).count();
+    if (queued) _metrics.queuedQueries++;
+    else _metrics.directQueries++;
+    _metrics.latencyTotal += latency;
+    if (latency > _metrics.latencyMax) _metrics.latencyMax = latency;
+    if (latency > _latencyTarget) _metrics.overTarget++;
+}
+
+
+
+
+SchedulerPriority::SchedulerPriority(CommandScheduler& scheduler) : _scheduler(scheduler) {
+    _scheduler._waiting.fetch_add(1, std::memory_order_acq_rel);
+    _scheduler._state.lock();
+    _scheduler._waiting.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+
+
+
+SchedulerPriority::~SchedulerPriority() {
+    _scheduler._state.unlock();
+}
+
+
+
+
+#endif
@@ -0,0 +1,159 @@
+/**********************************************************************************
+ *
+ * FILE:            csr_index.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Once the ingestion of a trace is over, the threads of the ETS no longer change,
+ * but every query still has to walk them node by node, resolving the dimension of
+ * each node through its own hash.
+ *
+ * The CsrIndex is the frozen, read-only form of one dimension family (all customer
+ * threads, or all package threads) in Compressed Sparse Row layout: the items of
+ * every thread are copied, in thread order, into one contiguous array, and a hash
+ * maps each key to the offset of its row. A query then becomes a contiguous scan.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef CSR_INDEX_HPP
+#define CSR_INDEX_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+
+
+
+
+// Contiguous row of a CsrIndex
+struct CsrSpan {
+    const int* items;
+    int size;
+
+    CsrSpan() : items(nullptr), size(0) {};
+    CsrSpan(const int* items, int size) : items(items), size(size) {};
+};
+
+
+
+
+template <typename KeyType>
+class CsrIndex
+{
+    private:
+        Hash<KeyType, int> _rows;
+        ArrayList<int> _offsets;
+        ArrayList<int> _items;
+
+    public:
+        explicit CsrIndex(size_t rows = 3) : _rows(rows) {};
+
+        // Sizes every array once, before the rows are appended
+        void reserve(int rows, int items);
+
+        // Rows must be built one at a time: beginRow, then its items in order
+        void beginRow(const KeyType& key);
+        void append(int item);
+
+        CsrSpan find(const KeyType& key) const;
+        // Calls function(key, span) for every row, in no particular order
+        template <typename Function>
+        void forEachRow(Function function) const;
+        int rowCount() const { return _offsets.getSize(); };
+        int itemCount() const { return _items.getSize(); };
+        void clear();
+
+        MemoryUsage memoryUsage() const;
+};
+
+
+
+
+template <typename KeyType>
+void CsrIndex<KeyType>::reserve(int rows, int items) {
+    _rows = Hash<KeyType, int>(rows);
+    _offsets = ArrayList<int>(rows);
+    _items = ArrayList<int>(items);
+}
+
+
+
+
+template <typename KeyType>
+void CsrIndex<KeyType>::beginRow(const KeyType& key) {
+    _rows.insert(key, _offsets.getSize());
+    _offsets.insertAtEnd(_items.getSize());
+}
+
+
+
+
+template <typename KeyType>
+void CsrIndex<KeyType>::append(int item) {
+    _items.insertAtEnd(item);
+}
+
+
+
+
+template <typename KeyType>
+CsrSpan CsrIndex<KeyType>::find(const KeyType& key) const {
+    const int* row = _rows.find(key);
+    if (row == nullptr) return CsrSpan();
+
+    int begin = _offsets[*row];
+    int end = (*row + 1 < _offsets.getSize()) ? _offsets[*row + 1] : _items.getSize();
+    return CsrSpan(_items.data() + begin, end - begin);
+}
+
+
+
+
+template <typename KeyType>
+template <typename Function>
+void CsrIndex<KeyType>::forEachRow(Function function) const {
+    _rows.forEach([&](const KeyType& key, const int& row) {
+        int end = (row + 1 < _offsets.getSize()) ? _offsets[row + 1] : _items.getSize();
+        function(key, CsrSpan(_items.data() + _offsets[row], end - _offsets[row]));
+    });
+}
+
+
+
+
+template <typename KeyType>
+MemoryUsage CsrIndex<KeyType>::memoryUsage() const {
+    MemoryUsage usage = _rows.memoryUsage();
+    usage += _offsets.memoryUsage();
+    usage += _items.memoryUsage();
+    return usage;
+}
+
+
+
+
+template <typename KeyType>
+void CsrIndex<KeyType>::clear() {
+    _rows = Hash<KeyType, int>();
+    _offsets = ArrayList<int>();
+    _items = ArrayList<int>();
+}
+
+
+
+
+#endif
@@ -67,9 +67,32 @@ class DimensionNode {
         DimensionNode() : item(-1), dimension(4) {};
 
         ~DimensionNode() = default;
+
+        // Read-only moves: they never insert the dimension into the node, so
+        // several threads may traverse the same nodes at once
+        DimensionNode<T>* next(const std::string& name) const;
+        DimensionNode<T>* prev(const std::string& name) const;
 };
 
 
 
 
+template <typename T>
+DimensionNode<T>* DimensionNode<T>::next(const std::string& name) const {
+    const Pointers* pointers = dimension.find(name);
+    return (pointers != nullptr) ? pointers->next : nullptr;
+}
+
+
+
+
+template <typename T>
+DimensionNode<T>* DimensionNode<T>::prev(const std::string& name) const {
+    const Pointers* pointers = dimension.find(name);
+    return (pointers != nullptr) ? pointers->prev : nullptr;
+}
+
+
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,369 @@
+/**********************************************************************************
+ *
+ * FILE:            event_columns.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Columnar (struct-of-arrays) copy of the fields of every event of the trace.
+ *
+ * The log store (see event_log.hpp) keeps each command packed for printing it, but
+ * aggregate questions need the raw fields at hand. Here every field has
+ * its own array, with one row per event, in the order the events arrived:
+ *
+ *   time        | type | package | origin | destination | section
+ *   ------------+------+---------+--------+-------------+--------
+ *   1000        |  RG  |    0    |    2   |      4      |   -1
+ *   1002        |  AR  |    0    |   -1   |      2      |    4
+ *
+ * Queries take no row. The nodes and the logs know an event by its command index,
+ * which a bitmap with one bit per command (set for the events) maps to its row:
+ * the row is the number of events before it, that is, the rows counted up to its
+ * 64-command word plus the set bits below it in the word.
+ *
+ * Fields an event does not carry are stored as -1. Since the trace arrives in
+ * nondecreasing time, a time window maps to a contiguous range of rows, found by
+ * binary search, which is then counted by a vectorized (AVX2) kernel with a scalar
+ * fallback for processors without it.
+ *
+ * The same time column answers windowed queries over a thread: the rows of a
+ * thread are chronological too, so the window is found by galloping from the most
+ * recent row, which is where the windows of interest usually are.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef EVENT_COLUMNS_HPP
+#define EVENT_COLUMNS_HPP
+
+#include "array_list.hpp"
+#include "trace_reader.hpp"
+
+#include <cstdint>
+#include <immintrin.h>
+
+
+
+
+// Event types counted by the aggregate kernels, in the order they are reported
+const CommandType EVENT_TYPES[] = {
+    CommandType::RG, CommandType::AR, CommandType::RM,
+    CommandType::UR, CommandType::TR, CommandType::EN
+};
+const int EVENT_TYPE_COUNT = 6;
+
+
+
+
+class EventColumns
+{
+    private:
+        // Command index -> row
+        int _commands;
+        ArrayList<uint64_t> _eventBits;
+        ArrayList<int> _rowsBefore;
+
+        ArrayList<int> _time;
+        ArrayList<int> _type;
+        ArrayList<int> _packageId;
+        ArrayList<int> _origin;
+        ArrayList<int> _destination;
+        ArrayList<int> _section;
+
+        int gallop(const int* rows, int size, int t, bool upper) const;
+        void countScalar(int begin, int end, int warehouse, int counts[]) const;
+        __attribute__((target("avx2")))
+        void countAVX2(int begin, int end, int warehouse, int counts[]) const;
+
+        int row(int i) const;
+
+    public:
+        explicit EventColumns(int capacity = 1000);
+
+        // Room for the given number of commands, of which the given number are events
+        void reserve(int commands, int events);
+        // Takes every command, so the command indices stay in step with the logs
+        void append(const Command& command);
+        int getSize() const { return _time.getSize(); };
+
+        MemoryUsage memoryUsage() const;
+        void shrinkToFit();
+
+        // Fields of the event under command index i
+        int time(int i) const { return _time[row(i)]; };
+        int packageId(int i) const { return _packageId[row(i)]; };
+
+        // First row with time >= t, and first row with time > t
+        int lowerBound(int t) const;
+        int upperBound(int t) const;
+
+        /* Same bounds over a chronological sequence of events, given by command
+        *  index, galloping from its end; they are positions in the sequence.
+        */
+        int lowerBound(const int* rows, int size, int t) const;
+        int upperBound(const int* rows, int size, int t) const;
+
+        /* Counts the events of each type of EVENT_TYPES in the rows [begin, end).
+        *  With warehouse >= 0 only events whose origin or destination is it count.
+        */
+        void countByType(int begin, int end, int warehouse, int counts[]) const;
+};
+
+
+
+
+EventColumns::EventColumns(int capacity)
+    : _commands(0), _eventBits(capacity / 64 + 1), _rowsBefore(capacity / 64 + 1), _time(capacity), _type(capacity), _packageId(capacity),
+      _origin(capacity), _destination(capacity), _section(capacity) {}
+
+
+
+
+void EventColumns::reserve(int commands, int events) {
+    _eventBits.reserve(commands / 64 + 1);
+    _rowsBefore.reserve(commands / 64 + 1);
+    _time.reserve(events);
+    _type.reserve(events);
+    _packageId.reserve(events);
+    _origin.reserve(events);
+    _destination.reserve(events);
+    _section.reserve(events);
+}
+
+
+
+
+MemoryUsage EventColumns::memoryUsage() const {
+    MemoryUsage usage = _eventBits.memoryUsage();
+    usage += _rowsBefore.memoryUsage();
+    usage += _time.memoryUsage();
+    usage += _type.memoryUsage();
+    usage += _packageId.memoryUsage();
+    usage += _origin.memoryUsage();
+    usage += _destination.memoryUsage();
+    usage += _section.memoryUsage();
+    return usage;
+}
+
+
+
+
+void EventColumns::shrinkToFit() {
+    _eventBits.shrinkToFit();
+    _rowsBefore.shrinkToFit();
+    _time.shrinkToFit();
+    _type.shrinkToFit();
+    _packageId.shrinkToFit();
+    _origin.shrinkToFit();
+    _destination.shrinkToFit();
+    _section.shrinkToFit();
+}
+
+
+
+
+int EventColumns::row(int i) const {
+    uint64_t below = _eventBits[i / 64] & ((uint64_t(1) << (i % 64)) - 1);
+    return _rowsBefore[i / 64] + __builtin_popcountll(below);
+}
+
+
+
+
+void EventColumns::append(const Command& command) {
+    int i = _commands++;
+    if (i % 64 == 0) {
+        _eventBits.insertAtEnd(0);
+        _rowsBefore.insertAtEnd(_time.getSize());
+    }
+    if (!command.isEvent()) return;
+    _eventBits[i / 64] |= uint64_t(1) << (i % 64);
+
+    int packageId = -1, origin = -1, destination = -1, section = -1;
+
+    switch (command.type) {
+        case CommandType::RG:
+        case CommandType::TR:
+            packageId = command.packageId;
+            origin = command.originWarehouseId;
+            destination = command.destinationWarehouseId;
+            break;
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            packageId = command.packageId;
+            destination = command.destinationWarehouseId;
+            section = command.targetSection;
+            break;
+        case CommandType::EN:
+            packageId = command.packageId;
+            destination = command.destinationWarehouseId;
+            break;
+        case CommandType::ST:
+            packageId = command.packageId;
+            break;
+        default:
+            break;
+    }
+
+    _time.insertAtEnd(command.time);
+    _type.insertAtEnd(static_cast<int>(command.type));
+    _packageId.insertAtEnd(packageId);
+    _origin.insertAtEnd(origin);
+    _destination.insertAtEnd(destination);
+    _section.insertAtEnd(section);
+}
+
+
+
+
+int EventColumns::lowerBound(int t) const {
+    int low = 0, high = _time.getSize();
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (_time[middle] < t) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+
+
+
+int EventColumns::upperBound(int t) const {
+    int low = 0, high = _time.getSize();
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (_time[middle] <= t) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+
+
+
+int EventColumns::lowerBound(const int* rows, int size, int t) const {
+    return gallop(rows, size, t, false);
+}
+
+
+
+
+int EventColumns::upperBound(const int* rows, int size, int t) const {
+    return gallop(rows, size, t, true);
+}
+
+
+
+/* Steps of 1, 2, 4, ... back from the end bracket the bound, which is then found
+*  by binary search inside the bracket: O(log d) for a bound d rows from the end.
+*/
+int EventColumns::gallop(const int* rows, int size, int t, bool upper) const {
+    int high = size;
+    int step = 1;
+    while (high > 0) {
+        int probe = (high - step > 0) ? high - step : 0;
+        int time = _time[row(rows[probe])];
+        if (upper ? time <= t : time < t) break;
+        high = probe;
+        step *= 2;
+    }
+
+    int low = (high - step > 0) ? high - step : 0;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        int time = _time[row(rows[middle])];
+        if (upper ? time <= t : time < t) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+
+
+
+void EventColumns::countByType(int begin, int end, int warehouse, int counts[]) const {
+    for (int k = 0; k < EVENT_TYPE_COUNT; k++) counts[k] = 0;
+    if (begin >= end) return;
+
+    if (__builtin_cpu_supports("avx2")) countAVX2(begin, end, warehouse, counts);
+    else countScalar(begin, end, warehouse, counts);
+}
+
+
+
+
+void EventColumns::countScalar(int begin, int end, int warehouse, int counts[]) const {
+    const int* type = _type.data();
+    const int* origin = _origin.data();
+    const int* destination = _destination.data();
+
+    for (int row = begin; row < end; row++) {
+        if (warehouse >= 0 && origin[row] != warehouse && destination[row] != warehouse) continue;
+        for (int k = 0; k < EVENT_TYPE_COUNT; k++)
+            counts[k] += (type[row] == static_cast<int>(EVENT_TYPES[k]));
+    }
+}
+
+
+
+// Eight rows per iteration; every comparison yields -1 per matching lane
+__attribute__((target("avx2")))
+void EventColumns::countAVX2(int begin, int end, int warehouse, int counts[]) const {
+    const int* type = _type.data();
+    const int* origin = _origin.data();
+    const int* destination = _destination.data();
+
+    __m256i typeKeys[EVENT_TYPE_COUNT];
+    __m256i sums[EVENT_TYPE_COUNT];
+    for (int k = 0; k < EVENT_TYPE_COUNT; k++) {
+        typeKeys[k] = _mm256_set1_epi32(static_cast<int>(EVENT_TYPES[k]));
+        sums[k] = _mm256_setzero_si256();
+    }
+    __m256i warehouseKey = _mm256_set1_epi32(warehouse);
+    __m256i all = _mm256_set1_epi32(-1);
+
+    int row = begin;
+    for (; row + 8 <= end; row += 8) {
+        __m256i types = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(type + row));
+        __m256i mask = all;
+        if (warehouse >= 0) {
+            __m256i origins = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(origin + row));
+            __m256i destinations = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destination + row));
+            mask = _mm256_or_si256(
+                _mm256_cmpeq_epi32(origins, warehouseKey),
+                _mm256_cmpeq_epi32(destinations, warehouseKey));
+        }
+        for (int k = 0; k < EVENT_TYPE_COUNT; k++) {
+            __m256i match = _mm256_and_si256(_mm256_cmpeq_epi32(types, typeKeys[k]), mask);
+            sums[k] = _mm256_sub_epi32(sums[k], match);
+        }
+    }
+
+    for (int k = 0; k < EVENT_TYPE_COUNT; k++) {
+        alignas(32) int lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sums[k]);
+        for (int lane = 0; lane < 8; lane++) counts[k] += lanes[lane];
+    }
+
+    countScalar(row, end, warehouse, counts);
+}
+
+
+
+
+#endif
@@ -0,0 +1,605 @@
+/**********************************************************************************
+ *
+ * FILE:            event_log.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Compressed in-memory store of every command of the trace, which the queries
+ * print as log lines.
+ *
+ * Keeping each line as its own preformatted std::string costs a heap block per
+ * command for the whole life of the process. Instead, the commands are encoded in
+ * a single byte array as records of variable length:
+ *
+ *   [type] [time - previous time] [fields of the type ...]
+ *
+ * Integers are zigzag varints (one byte for values below 64), time stamps and
+ * package ids are stored as the difference to the previous record, and customer
+ * names are interned once and referenced by id.
+ *
+ * Records are grouped in blocks of BLOCK_RECORDS. The block index keeps where each
+ * block starts and its first time stamp, so the line of command i is rendered by
+ * jumping to its block and decoding at most BLOCK_RECORDS records.
+ *
+ * The bytes are kept in a chain of segments of LOG_SEGMENT_BYTES rather than in
+ * one array, so the log is not bounded by the int sizes of an ArrayList and never
+ * copies what it holds to grow. A block always lies within a single segment: a new
+ * segment is started whenever the current one has no room for a whole block.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef EVENT_LOG_HPP
+#define EVENT_LOG_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+#include "trace_reader.hpp"
+#include "format.hpp"
+
+#include <string>
+
+
+
+
+const int BLOCK_RECORDS = 64;
+
+// Bytes of each segment, and the most a record takes: the type and six 5-byte varints (RG)
+const int LOG_SEGMENT_BYTES = 1 << 20;
+const int MAX_RECORD_BYTES = 1 + 6 * 5;
+
+// Bytes a record takes on average, to size the segment list up front
+const int RECORD_BYTES_ESTIMATE = 8;
+
+
+
+// Where a block starts (its segment and the offset in it) and the time its deltas are based on
+struct BlockIndex {
+    int segment = 0;
+    int offset = 0;
+    int baseTime = 0;
+};
+
+
+
+
+class EventLog
+{
+    private:
+        ArrayList<ArrayList<unsigned char>> _segments;
+        // Segment the records are appended to, the last one
+        ArrayList<unsigned char>* _segment;
+        ArrayList<BlockIndex> _blocks;
+        Hash<std::string, int> _customerIds;
+        ArrayList<std::string> _customerNames;
+        int _size;
+        int _lastTime;
+        int _lastPackageId;
+
+        void addSegment();
+        void putVarint(int value);
+        int customerId(const std::string& name);
+        void decodeRecord(const unsigned char*& cursor, int& time, int& packageId, Command& command, int customerIds[2], bool names) const;
+        static int getVarint(const unsigned char*& cursor);
+
+    public:
+        explicit EventLog(int capacity = 1000);
+        EventLog(const EventLog& other) = delete;
+        EventLog& operator=(const EventLog& other) = delete;
+
+        // Sizes the segment list and the block index for records commands
+        void reserve(int records);
+        void append(const Command& command);
+        int getSize() const { return _size; };
+
+        // Appends the log line of command i to out, without a line break
+        void render(int i, std::string& out) const;
+        std::string operator[](int i) const;
+        void decode(int i, Command& command) const;
+        // Log line of a command, the same render() gives for it once appended
+        static void format(const Command& command, std::string& out);
+
+        /* Decodes the commands [begin, end) in order, each block once, calling
+        *  function(i, command, customerIds) with the interned ids of the names of the
+        *  command (sender and recipient of RG, the customer of CL, CW and ST, or -1).
+        */
+        template <typename Function>
+        void forEach(int begin, int end, Function function) const;
+
+        // Interned customer names: ids are dense and never change
+        int customerCount() const { return _customerNames.getSize(); };
+        const std::string& customerName(int id) const { return _customerNames[id]; };
+        int findCustomer(const std::string& name) const;
+
+        MemoryUsage memoryUsage() const;
+        void shrinkToFit();
+};
+
+
+
+
+EventLog::EventLog(int capacity)
+    : _segments(capacity / (LOG_SEGMENT_BYTES / RECORD_BYTES_ESTIMATE) + 1), _segment(nullptr),
+      _blocks(capacity / BLOCK_RECORDS + 1), _customerIds(capacity / 4),
+      _customerNames(capacity / 4 + 1), _size(0), _lastTime(0), _lastPackageId(0) {}
+
+
+
+
+void EventLog::reserve(int records) {
+    _segments.reserve(records / (LOG_SEGMENT_BYTES / RECORD_BYTES_ESTIMATE) + 1);
+    _blocks.reserve(records / BLOCK_RECORDS + 1);
+}
+
+
+
+
+void EventLog::addSegment() {
+    _segments.emplace_back(LOG_SEGMENT_BYTES);
+    _segment = &_segments[_segments.getSize() - 1];
+}
+
+
+
+// Zigzag keeps small negative values small: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+void EventLog::putVarint(int value) {
+    unsigned int zigzag = (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+    while (zigzag >= 0x80) {
+        _segment->insertAtEnd(static_cast<unsigned char>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    _segment->insertAtEnd(static_cast<unsigned char>(zigzag));
+}
+
+
+
+
+int EventLog::getVarint(const unsigned char*& cursor) {
+    unsigned int zigzag = 0;
+    int shift = 0;
+    while (*cursor & 0x80) {
+        zigzag |= static_cast<unsigned int>(*cursor++ & 0x7F) << shift;
+        shift += 7;
+    }
+    zigzag |= static_cast<unsigned int>(*cursor++) << shift;
+    return static_cast<int>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+}
+
+
+
+
+int EventLog::findCustomer(const std::string& name) const {
+    const int* id = _customerIds.find(name);
+    return (id != nullptr) ? *id : -1;
+}
+
+
+
+
+int EventLog::customerId(const std::string& name) {
+    const int* id = _customerIds.find(name);
+    if (id != nullptr) return *id;
+
+    int newId = _customerNames.getSize();
+    _customerIds.insert(name, newId);
+    _customerNames.insertAtEnd(name);
+    return newId;
+}
+
+
+
+
+void EventLog::append(const Command& command) {
+    if (_size % BLOCK_RECORDS == 0) {
+        // The whole block must fit in the segment, so the segment never grows
+        if (_segment == nullptr || _segment->getCapacity() - _segment->getSize() < BLOCK_RECORDS * MAX_RECORD_BYTES)
+            addSegment();
+        BlockIndex block;
+        block.segment = _segments.getSize() - 1;
+        block.offset = _segment->getSize();
+        block.baseTime = command.time;
+        _blocks.insertAtEnd(block);
+        _lastTime = command.time;
+        _lastPackageId = 0;
+    }
+
+    _segment->insertAtEnd(static_cast<unsigned char>(command.type));
+    putVarint(command.time - _lastTime);
+    _lastTime = command.time;
+
+    switch (command.type) {
+        case CommandType::CL:
+            putVarint(customerId(command.customerName));
+            break;
+        case CommandType::CW:
+            putVarint(customerId(command.customerName));
+            putVarint(command.windowBegin);
+            putVarint(command.windowEnd);
+            break;
+        case CommandType::PC:
+        case CommandType::PW:
+        case CommandType::RG:
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+        case CommandType::TR:
+        case CommandType::EN:
+        case CommandType::ST:
+            putVarint(command.packageId - _lastPackageId);
+            _lastPackageId = command.packageId;
+            break;
+        default:
+            break;
+    }
+
+    switch (command.type) {
+        case CommandType::PW:
+        case CommandType::AG:
+            putVarint(command.windowBegin);
+            putVarint(command.windowEnd);
+            break;
+        case CommandType::WT:
+            putVarint(command.warehouseId);
+            putVarint(command.windowBegin);
+            putVarint(command.windowEnd);
+            break;
+        case CommandType::WP:
+            putVarint(command.warehouseId);
+            break;
+        case CommandType::SP:
+            putVarint(command.warehouseId);
+            putVarint(command.targetSection);
+            break;
+        case CommandType::RG:
+            putVarint(customerId(command.sender));
+            putVarint(customerId(command.recipient));
+            putVarint(command.originWarehouseId);
+            putVarint(command.destinationWarehouseId);
+            break;
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            putVarint(command.destinationWarehouseId);
+            putVarint(command.targetSection);
+            break;
+        case CommandType::TR:
+            putVarint(command.originWarehouseId);
+            putVarint(command.destinationWarehouseId);
+            break;
+        case CommandType::EN:
+            putVarint(command.destinationWarehouseId);
+            break;
+        case CommandType::ST:
+            putVarint(customerId(command.customerName));
+            break;
+        case CommandType::TC:
+        case CommandType::TP:
+            putVarint(command.limit);
+            break;
+        default:
+            break;
+    }
+
+    _size++;
+}
+
+
+
+// Decodes the record at cursor and moves past it; names are only copied when asked for
+void EventLog::decodeRecord(const unsigned char*& cursor, int& time, int& packageId, Command& command, int customerIds[2], bool names) const {
+    command.type = static_cast<CommandType>(*cursor++);
+    time += getVarint(cursor);
+    command.time = time;
+    customerIds[0] = customerIds[1] = -1;
+
+    switch (command.type) {
+        case CommandType::CL:
+            customerIds[0] = getVarint(cursor);
+            if (names) command.customerName = _customerNames[customerIds[0]];
+            break;
+        case CommandType::CW:
+            customerIds[0] = getVarint(cursor);
+            if (names) command.customerName = _customerNames[customerIds[0]];
+            command.windowBegin = getVarint(cursor);
+            command.windowEnd = getVarint(cursor);
+            break;
+        case CommandType::PC:
+        case CommandType::PW:
+        case CommandType::RG:
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+        case CommandType::TR:
+        case CommandType::EN:
+        case CommandType::ST:
+            packageId += getVarint(cursor);
+            command.packageId = packageId;
+            break;
+        default:
+            break;
+    }
+
+    switch (command.type) {
+        case CommandType::PW:
+        case CommandType::AG:
+            command.windowBegin = getVarint(cursor);
+            command.windowEnd = getVarint(cursor);
+            break;
+        case CommandType::WT:
+            command.warehouseId = getVarint(cursor);
+            command.windowBegin = getVarint(cursor);
+            command.windowEnd = getVarint(cursor);
+            break;
+        case CommandType::WP:
+            command.warehouseId = getVarint(cursor);
+            break;
+        case CommandType::SP:
+            command.warehouseId = getVarint(cursor);
+            command.targetSection = getVarint(cursor);
+            break;
+        case CommandType::RG:
+            customerIds[0] = getVarint(cursor);
+            customerIds[1] = getVarint(cursor);
+            if (names) {
+                command.sender = _customerNames[customerIds[0]];
+                command.recipient = _customerNames[customerIds[1]];
+            }
+            command.originWarehouseId = getVarint(cursor);
+            command.destinationWarehouseId = getVarint(cursor);
+            break;
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            command.destinationWarehouseId = getVarint(cursor);
+            command.targetSection = getVarint(cursor);
+            break;
+        case CommandType::TR:
+            command.originWarehouseId = getVarint(cursor);
+            command.destinationWarehouseId = getVarint(cursor);
+            break;
+        case CommandType::EN:
+            command.destinationWarehouseId = getVarint(cursor);
+            break;
+        case CommandType::ST:
+            customerIds[0] = getVarint(cursor);
+            if (names) command.customerName = _customerNames[customerIds[0]];
+            break;
+        case CommandType::TC:
+        case CommandType::TP:
+            command.limit = getVarint(cursor);
+            break;
+        default:
+            break;
+    }
+}
+
+
+
+
+void EventLog::decode(int i, Command& command) const {
+    if (i < 0 || i >= _size) throw std::out_of_range("Invalid index: EventLog::decode");
+
+    const BlockIndex& block = _blocks[i / BLOCK_RECORDS];
+    const unsigned char* cursor = _segments[block.segment].data() + block.offset;
+    int time = block.baseTime;
+    int packageId = 0;
+    int customerIds[2];
+
+    // Skips the records of the block before the requested one
+    for (int record = 0; record < i % BLOCK_RECORDS; record++)
+        decodeRecord(cursor, time, packageId, command, customerIds, false);
+    decodeRecord(cursor, time, packageId, command, customerIds, true);
+}
+
+
+
+
+template <typename Function>
+void EventLog::forEach(int begin, int end, Function function) const {
+    if (begin < 0 || end > _size) throw std::out_of_range("Invalid range: EventLog::forEach");
+    Command command;
+    int customerIds[2];
+
+    for (int i = begin; i < end; ) {
+        const BlockIndex& block = _blocks[i / BLOCK_RECORDS];
+        const unsigned char* cursor = _segments[block.segment].data() + block.offset;
+        int time = block.baseTime;
+        int packageId = 0;
+
+        int record = 0;
+        for (; record < i % BLOCK_RECORDS; record++)
+            decodeRecord(cursor, time, packageId, command, customerIds, false);
+        for (; record < BLOCK_RECORDS && i < end; record++, i++) {
+            decodeRecord(cursor, time, packageId, command, customerIds, true);
+            function(i, command, customerIds);
+        }
+    }
+}
+
+
+
+
+void EventLog::render(int i, std::string& out) const {
+    Command command;
+    decode(i, command);
+    format(command, out);
+}
+
+
+
+
+void EventLog::format(const Command& command, std::string& out) {
+    // Queries carry a 6-digit time stamp and events a 7-digit one
+    switch (command.type) {
+        case CommandType::CL:
+            appendPadded(out, command.time, 6);
+            out += " CL ";
+            out += command.customerName;
+            break;
+        case CommandType::PC:
+            appendPadded(out, command.time, 6);
+            out += " PC ";
+            appendPadded(out, command.packageId, 3);
+            break;
+        case CommandType::CW:
+            appendPadded(out, command.time, 6);
+            out += " CW ";
+            out += command.customerName;
+            out += ' ';
+            appendPadded(out, command.windowBegin, 7);
+            out += ' ';
+            appendPadded(out, command.windowEnd, 7);
+            break;
+        case CommandType::PW:
+            appendPadded(out, command.time, 6);
+            out += " PW ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            appendPadded(out, command.windowBegin, 7);
+            out += ' ';
+            appendPadded(out, command.windowEnd, 7);
+            break;
+        case CommandType::FZ:
+            appendPadded(out, command.time, 6);
+            out += " FZ";
+            break;
+        case CommandType::AG:
+            appendPadded(out, command.time, 6);
+            out += " AG ";
+            appendPadded(out, command.windowBegin, 7);
+            out += ' ';
+            appendPadded(out, command.windowEnd, 7);
+            break;
+        case CommandType::WT:
+            appendPadded(out, command.time, 6);
+            out += " WT ";
+            appendPadded(out, command.warehouseId, 3);
+            out += ' ';
+            appendPadded(out, command.windowBegin, 7);
+            out += ' ';
+            appendPadded(out, command.windowEnd, 7);
+            break;
+        case CommandType::WP:
+            appendPadded(out, command.time, 6);
+            out += " WP ";
+            appendPadded(out, command.warehouseId, 3);
+            break;
+        case CommandType::SP:
+            appendPadded(out, command.time, 6);
+            out += " SP ";
+            appendPadded(out, command.warehouseId, 3);
+            out += ' ';
+            appendPadded(out, command.targetSection, 3);
+            break;
+        case CommandType::RG:
+            appendPadded(out, command.time, 7);
+            out += " EV RG ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            out += command.sender;
+            out += ' ';
+            out += command.recipient;
+            out += ' ';
+            appendPadded(out, command.originWarehouseId, 3);
+            out += ' ';
+            appendPadded(out, command.destinationWarehouseId, 3);
+            break;
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            appendPadded(out, command.time, 7);
+            out += (command.type == CommandType::AR) ? " EV AR "
+                 : (command.type == CommandType::RM) ? " EV RM " : " EV UR ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            appendPadded(out, command.destinationWarehouseId, 3);
+            out += ' ';
+            appendPadded(out, command.targetSection, 3);
+            break;
+        case CommandType::TR:
+            appendPadded(out, command.time, 7);
+            out += " EV TR ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            appendPadded(out, command.originWarehouseId, 3);
+            out += ' ';
+            appendPadded(out, command.destinationWarehouseId, 3);
+            break;
+        case CommandType::EN:
+            appendPadded(out, command.time, 7);
+            out += " EV EN ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            appendPadded(out, command.destinationWarehouseId, 3);
+            break;
+        case CommandType::ST:
+            appendPadded(out, command.time, 7);
+            out += " EV ST ";
+            appendPadded(out, command.packageId, 3);
+            out += ' ';
+            out += command.customerName;
+            break;
+        case CommandType::TC:
+        case CommandType::TP:
+            appendPadded(out, command.time, 6);
+            out += (command.type == CommandType::TC) ? " TC " : " TP ";
+            appendInt(out, command.limit);
+            break;
+        case CommandType::UNKNOWN:
+            break;
+    }
+}
+
+
+
+
+std::string EventLog::operator[](int i) const {
+    std::string line;
+    render(i, line);
+    return line;
+}
+
+
+
+
+MemoryUsage EventLog::memoryUsage() const {
+    MemoryUsage usage = _segments.memoryUsage();
+    for (int k = 0; k < _segments.getSize(); k++)
+        usage += _segments[k].memoryUsage();
+    usage += _blocks.memoryUsage();
+    usage += _customerIds.memoryUsage();
+    usage += _customerNames.memoryUsage();
+    return usage;
+}
+
+
+
+
+void EventLog::shrinkToFit() {
+    // Only the last segment has room left; the next block then starts a new one
+    if (_segment != nullptr) _segment->shrinkToFit();
+    _segments.shrinkToFit();
+    if (_segment != nullptr) _segment = &_segments[_segments.getSize() - 1];
+    _blocks.shrinkToFit();
+    _customerIds.shrinkToFit();
+    _customerNames.shrinkToFit();
+}
+
+
+
+
+#endif
@@ -0,0 +1,131 @@
+/**********************************************************************************
+ *
+ * FILE:            format.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Integer formatting for the log lines and the answers, which print a few numbers
+ * per line, most of them zero-padded to a fixed width.
+ *
+ * The digits are produced two at a time from a table of the pairs "00" to "99",
+ * right to left, straight into the output; the length is known up front, so the
+ * padding is a single fill and nothing is built in between (no std::to_string,
+ * no stream). The bytes are those of std::setfill('0') << std::setw(width), which
+ * pads a negative value before its sign.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <string>
+#include <cstring>
+
+
+
+
+const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+
+
+inline int decimalDigits(unsigned long value) {
+    int digits = 1;
+    while (value >= 100) {
+        value /= 100;
+        digits += 2;
+    }
+    return digits + (value >= 10);
+}
+
+
+
+// Writes the digits of value so that they end right before end
+inline void writeDigits(char* end, unsigned long value) {
+    while (value >= 100) {
+        const char* pair = DIGIT_PAIRS + (value % 100) * 2;
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        const char* pair = DIGIT_PAIRS + value * 2;
+        *--end = pair[1];
+        *--end = pair[0];
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+}
+
+
+
+
+inline int paddedLength(long value, int width) {
+    unsigned long magnitude = (value < 0) ? 0UL - static_cast<unsigned long>(value) : value;
+    int length = decimalDigits(magnitude) + (value < 0);
+    return (length < width) ? width : length;
+}
+
+
+
+/* Writes value, zero-padded to width, at buffer, which has room for
+*  paddedLength(value, width) characters; returns the end of what was written.
+*/
+inline char* formatPadded(char* buffer, long value, int width) {
+    unsigned long magnitude = (value < 0) ? 0UL - static_cast<unsigned long>(value) : value;
+    int digits = decimalDigits(magnitude);
+    int length = digits + (value < 0);
+    if (length < width) {
+        memset(buffer, '0', width - length);
+        buffer += width - length;
+    }
+    if (value < 0) *buffer++ = '-';
+    writeDigits(buffer + digits, magnitude);
+    return buffer + digits;
+}
+
+
+
+
+inline void appendPadded(std::string& out, long value, int width) {
+    size_t at = out.size();
+    out.resize(at + paddedLength(value, width));
+    formatPadded(&out[at], value, width);
+}
+
+
+
+// Same as out += std::to_string(value)
+inline void appendInt(std::string& out, long value) {
+    appendPadded(out, value, 0);
+}
+
+
+
+
+#endif
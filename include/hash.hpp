@@ -1,6 +1,8 @@
 /*
 * Implementação da função hash com size_t para não ter problema de tamanho da chave
-* e sondagem quadrática para evitar colisões.
+* e sondagem linear para resolver colisões. A remoção desloca para trás os pares
+* seguintes da sequência (backward shift), então a tabela nunca acumula lápides e
+* o custo de uma busca depende só da lotação atual.
 */ 
 
 #ifndef HASH_HPP
@@ -46,7 +48,7 @@ size_t findNextPrime(size_t n) {
 
 
 
-enum class SlotState { EMPTY, OCCUPIED, TOMBSTONE };
+enum class SlotState { EMPTY, OCCUPIED };
 
 template <typename T>
 struct EqualTo {
@@ -112,14 +114,34 @@ class Hash
 
         ArrayList<HashSlot> _vector;
         size_t _size = 0;
-        // Sempre que chega a lotação abaixo é dobrado o tamanho da tabela
+        // Inserção que passaria desta lotação dobra antes o tamanho da tabela; assim
+        // sempre sobra uma posição vazia, que encerra a sondagem (mesmo com 2 ou 3 posições).
+        // Consultas a chaves existentes nunca causam rehash
         float _maxCapacity = 0.7f;
+        // Abaixo desta lotação, após uma remoção, a tabela é reduzida à metade
+        float _minCapacity = 0.2f;
+        // Tamanho inicial da tabela, abaixo do qual ela não é reduzida
+        size_t _minSlots;
         HasherType _hasher;
         KeyEqualType _keyEqual;
 
+        // Contador externo dos bytes da tabela (ver trackBytes): cópias da tabela não o herdam
+        struct BytesCounter {
+            size_t* total = nullptr;
 
-        size_t findPos(const KeyType& key) const;
+            BytesCounter() = default;
+            BytesCounter(const BytesCounter&) {}
+            BytesCounter& operator=(const BytesCounter&) { total = nullptr; return *this; }
+        };
+        BytesCounter _counter;
+
+
+        size_t home(size_t hash) const;
+        void addBytes(size_t bytes);
+        void removeBytes(size_t bytes);
+        size_t findPos(const KeyType& key, size_t hash) const;
         void rehash();
+        void rebuild(size_t newCapacity);
 
     public:
         explicit Hash(size_t initialSize = 3);
@@ -130,6 +152,37 @@ class Hash
         size_t size() const;
         bool empty() const;
         ValueType& operator[](const KeyType& key);
+
+        // Dimensiona a tabela para receber count chaves sem novos rehash
+        void reserve(size_t count);
+
+        // Consulta sem inserir a chave (nullptr se ela não existir)
+        const ValueType* find(const KeyType& key) const;
+
+        /* Mesmas operações com o hash da chave já calculado por hashOf, para quem consulta
+        *  a mesma chave várias vezes (ou em várias tabelas com o mesmo HasherType).
+        *  O hash não depende do tamanho da tabela, então continua válido após um rehash.
+        */
+        size_t hashOf(const KeyType& key) const;
+        const ValueType* find(const KeyType& key, size_t hash) const;
+        // Antecipa para a cache a posição inicial da chave, sem consultar nem alterar a tabela
+        void prefetchHash(size_t hash) const;
+        // Como operator[]
+        ValueType& get(const KeyType& key, size_t hash);
+
+        // Percorre todos os pares ocupados na ordem da tabela
+        template <typename Function>
+        void forEach(Function function) const;
+
+        // Memória da tabela e das chaves e valores; shrinkToFit reduz a tabela ao mínimo para _size
+        MemoryUsage memoryUsage() const;
+        void shrinkToFit();
+
+        /* Soma a *total os bytes da tabela (posições e o que chaves e valores alocam ao
+        *  entrar) e o mantém em dia a cada inserção, remoção e rehash, até trackBytes(nullptr),
+        *  que os retira de lá. O que um valor passe a alocar depois de inserido não é visto.
+        */
+        void trackBytes(size_t* total);
 };
 
 
@@ -137,34 +190,34 @@ class Hash
 
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
 Hash<KeyType, ValueType, HasherType, KeyEqualType>::Hash(size_t initialSize) 
-    : _vector(findNextPrime(initialSize > 0 ? initialSize : 3)) {}
+    : _vector(0), _minSlots(findNextPrime(initialSize > 0 ? initialSize : 3)) {
+    _vector.assign(_minSlots, HashSlot());
+}
+
 
 
 
-// Algoritmo de sondagem quadrática para evitar colisões
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
-size_t Hash<KeyType, ValueType, HasherType, KeyEqualType>::findPos(const KeyType& key) const {
-    size_t tableCapacity = _vector.getCapacity();
-    if (tableCapacity == 0) return 0;
+size_t Hash<KeyType, ValueType, HasherType, KeyEqualType>::home(size_t hash) const {
+    return hash % _vector.getSize();
+}
 
-    size_t originalIndex = _hasher(key) % tableCapacity;
-    size_t tombstonePos = -1;
 
-    for (size_t i = 0; i < tableCapacity; i++) 
-    {
-        size_t index = (originalIndex + i * i) % tableCapacity;
 
-        if (_vector[index].state == SlotState::EMPTY)
-            return (tombstonePos != (size_t)-1) ? tombstonePos : index;
+/* Sondagem linear: a posição da chave ou, se ela não estiver na tabela, a posição
+*  vazia que encerra a sequência. A lotação máxima garante que sempre há uma.
+*/
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+size_t Hash<KeyType, ValueType, HasherType, KeyEqualType>::findPos(const KeyType& key, size_t hash) const {
+    size_t tableCapacity = _vector.getSize();
+    if (tableCapacity == 0) return 0;
 
-        if (_vector[index].state == SlotState::TOMBSTONE) 
-        {
-            if (tombstonePos == (size_t)-1) tombstonePos = index;
-        } else if (_keyEqual(_vector[index].key, key)) {
-            return index;
-        }
+    size_t index = home(hash);
+    while (_vector[index].state == SlotState::OCCUPIED && !_keyEqual(_vector[index].key, key)) {
+        index++;
+        if (index == tableCapacity) index = 0;
     }
-    return tombstonePos != (size_t)-1 ? tombstonePos : originalIndex;
+    return index;
 }
 
 
@@ -172,16 +225,32 @@ size_t Hash<KeyType, ValueType, HasherType, KeyEqualType>::findPos(const KeyType
 
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
 void Hash<KeyType, ValueType, HasherType, KeyEqualType>::rehash() {
+    rebuild(findNextPrime(_vector.getSize() * 2));
+}
+
+
+
+// Reinsere todos os pares em uma tabela nova de newCapacity posições
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::rebuild(size_t newCapacity) {
+    removeBytes(_vector.getCapacity() * sizeof(HashSlot));
     ArrayList<HashSlot> oldTable = my_move(_vector);
-    size_t oldCapacity = oldTable.getCapacity();
-    size_t newCapacity = findNextPrime(oldCapacity * 2);
-    _vector = ArrayList<HashSlot>(newCapacity);
+    size_t oldCapacity = oldTable.getSize();
+    _vector.assign(newCapacity, HashSlot());
+    addBytes(_vector.getCapacity() * sizeof(HashSlot));
     _size = 0;
 
+    // As chaves são distintas: cada par vai para a primeira posição vazia a partir da sua
     for (size_t i = 0; i < oldCapacity; ++i) {
-        if (oldTable[i].state == SlotState::OCCUPIED) {
-            insert(oldTable[i].key, oldTable[i].value);
+        if (oldTable[i].state != SlotState::OCCUPIED) continue;
+
+        size_t index = home(_hasher(oldTable[i].key));
+        while (_vector[index].state == SlotState::OCCUPIED) {
+            index++;
+            if (index == newCapacity) index = 0;
         }
+        _vector[index] = my_move(oldTable[i]);
+        _size++;
     }
 }
 
@@ -190,16 +259,22 @@ void Hash<KeyType, ValueType, HasherType, KeyEqualType>::rehash() {
 
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
 bool Hash<KeyType, ValueType, HasherType, KeyEqualType>::insert(const KeyType& key, const ValueType& value) {
-    if (_vector.getCapacity() == 0 || _size >= _vector.getCapacity() * _maxCapacity) rehash();
+    if (_vector.getSize() == 0) rehash();
 
-    size_t pos = findPos(key);
+    size_t hash = _hasher(key);
+    size_t pos = findPos(key, hash);
 
     if (_vector[pos].state == SlotState::OCCUPIED) return false;
+    if (_size + 1 > _vector.getSize() * _maxCapacity) {
+        rehash();
+        pos = findPos(key, hash);
+    }
 
     _vector[pos].key = key;
     _vector[pos].value = value;
     _vector[pos].state = SlotState::OCCUPIED;
     _size++;
+    addBytes(heapBytes(_vector[pos].key) + heapBytes(_vector[pos].value));
     return true;
 }
 
@@ -210,12 +285,30 @@ template <typename KeyType, typename ValueType, typename HasherType, typename Ke
 bool Hash<KeyType, ValueType, HasherType, KeyEqualType>::erase(const KeyType& key) {
     if (empty()) return false;
 
-    size_t pos = findPos(key);
+    size_t pos = findPos(key, _hasher(key));
 
     if (_vector[pos].state != SlotState::OCCUPIED) return false;
-
-    _vector[pos].state = SlotState::TOMBSTONE;
+    removeBytes(heapBytes(_vector[pos].key) + heapBytes(_vector[pos].value));
+
+    /* Backward shift: percorre os pares seguintes até uma posição vazia e traz para
+    *  o buraco cada um cuja posição inicial não esteja entre o buraco e ele, pois
+    *  a sondagem dele passa pelo buraco. O par movido abre um novo buraco.
+    */
+    size_t tableCapacity = _vector.getSize();
+    size_t hole = pos;
+    for (size_t index = (pos + 1) % tableCapacity; _vector[index].state == SlotState::OCCUPIED; index = (index + 1) % tableCapacity) {
+        size_t start = home(_hasher(_vector[index].key));
+        bool between = (hole <= index) ? (hole < start && start <= index) : (hole < start || start <= index);
+        if (between) continue;
+
+        _vector[hole] = my_move(_vector[index]);
+        hole = index;
+    }
+    // Libera também o que a chave e o valor alocam
+    _vector[hole] = HashSlot();
     _size--;
+
+    if (_size < tableCapacity * _minCapacity && tableCapacity / 2 >= _minSlots) rebuild(findNextPrime(tableCapacity / 2));
     return true;
 }
 
@@ -226,7 +319,7 @@ template <typename KeyType, typename ValueType, typename HasherType, typename Ke
 bool Hash<KeyType, ValueType, HasherType, KeyEqualType>::contains(const KeyType& key) const {
     if (empty()) return false;
 
-    size_t pos = findPos(key);
+    size_t pos = findPos(key, _hasher(key));
 
     return _vector[pos].state == SlotState::OCCUPIED;
 }
@@ -236,9 +329,10 @@ bool Hash<KeyType, ValueType, HasherType, KeyEqualType>::contains(const KeyType&
 
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
 void Hash<KeyType, ValueType, HasherType, KeyEqualType>::clear() {
-    _vector.clear();
-    _vector.resize(16);
+    if (_counter.total != nullptr) removeBytes(memoryUsage().bytes);
+    _vector.assign(_minSlots, HashSlot());
     _size = 0;
+    addBytes(_vector.getCapacity() * sizeof(HashSlot));
 }
 
 
@@ -265,15 +359,28 @@ bool Hash<KeyType, ValueType, HasherType, KeyEqualType>::empty() const {
 */
 template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
 ValueType& Hash<KeyType, ValueType, HasherType, KeyEqualType>::operator[](const KeyType& key) {
-    if (_vector.getCapacity() == 0 || _size >= _vector.getCapacity() * _maxCapacity) rehash();
+    return get(key, _hasher(key));
+}
+
+
 
-    size_t pos = findPos(key);
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+ValueType& Hash<KeyType, ValueType, HasherType, KeyEqualType>::get(const KeyType& key, size_t hash) {
+    if (_vector.getSize() == 0) rehash();
+
+    size_t pos = findPos(key, hash);
 
     if (_vector[pos].state != SlotState::OCCUPIED) {
+        if (_size + 1 > _vector.getSize() * _maxCapacity) {
+            rehash();
+            pos = findPos(key, hash);
+        }
         _vector[pos].key = key;
         _vector[pos].state = SlotState::OCCUPIED;
         _vector[pos].value = ValueType{};
         _size++;
+        addBytes(heapBytes(_vector[pos].key) + heapBytes(_vector[pos].value));
     }
 
     return _vector[pos].value;
@@ -282,4 +389,121 @@ ValueType& Hash<KeyType, ValueType, HasherType, KeyEqualType>::operator[](const
 
 
 
-#endif
\ No newline at end of file
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::reserve(size_t count) {
+    size_t newCapacity = findNextPrime(count / _maxCapacity + 1);
+    if (newCapacity <= (size_t)_vector.getSize()) return;
+
+    rebuild(newCapacity);
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+const ValueType* Hash<KeyType, ValueType, HasherType, KeyEqualType>::find(const KeyType& key) const {
+    return find(key, _hasher(key));
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+const ValueType* Hash<KeyType, ValueType, HasherType, KeyEqualType>::find(const KeyType& key, size_t hash) const {
+    if (empty()) return nullptr;
+
+    size_t pos = findPos(key, hash);
+
+    if (_vector[pos].state != SlotState::OCCUPIED) return nullptr;
+    return &_vector[pos].value;
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::prefetchHash(size_t hash) const {
+    size_t tableCapacity = _vector.getSize();
+    if (tableCapacity == 0) return;
+
+    __builtin_prefetch(_vector.data() + hash % tableCapacity);
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+size_t Hash<KeyType, ValueType, HasherType, KeyEqualType>::hashOf(const KeyType& key) const {
+    return _hasher(key);
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+template <typename Function>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::forEach(Function function) const {
+    size_t tableCapacity = _vector.getSize();
+    for (size_t i = 0; i < tableCapacity; i++) {
+        if (_vector[i].state == SlotState::OCCUPIED)
+            function(_vector[i].key, _vector[i].value);
+    }
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+MemoryUsage Hash<KeyType, ValueType, HasherType, KeyEqualType>::memoryUsage() const {
+    MemoryUsage usage;
+    usage.bytes = _vector.getCapacity() * sizeof(HashSlot);
+    usage.usedBytes = _size * sizeof(HashSlot);
+    forEach([&](const KeyType& key, const ValueType& value) {
+        size_t bytes = heapBytes(key) + heapBytes(value);
+        usage.bytes += bytes;
+        usage.usedBytes += bytes;
+    });
+    return usage;
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::shrinkToFit() {
+    size_t newCapacity = findNextPrime(_size / _maxCapacity + 1);
+    if (newCapacity >= (size_t)_vector.getSize()) return;
+
+    rebuild(newCapacity);
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::addBytes(size_t bytes) {
+    if (_counter.total != nullptr) *_counter.total += bytes;
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::removeBytes(size_t bytes) {
+    if (_counter.total != nullptr) *_counter.total -= bytes;
+}
+
+
+
+
+template <typename KeyType, typename ValueType, typename HasherType, typename KeyEqualType>
+void Hash<KeyType, ValueType, HasherType, KeyEqualType>::trackBytes(size_t* total) {
+    if (_counter.total != nullptr) removeBytes(memoryUsage().bytes);
+    _counter.total = total;
+    if (_counter.total != nullptr) addBytes(memoryUsage().bytes);
+}
+
+
+
+
+#endif
@@ -17,8 +17,10 @@ class LinkedList
         int size;
         DimensionNode<T>* head; 
         DimensionNode<T>* tail; 
+        // Incremented whenever the list changes, to tell stale copies apart
+        unsigned int version;
 
-        LinkedList() : size(0), head(nullptr), tail(nullptr) {};
+        LinkedList() : size(0), head(nullptr), tail(nullptr), version(0) {};
         ~LinkedList() = default;
         
         int getSize() const { return size; };
@@ -0,0 +1,173 @@
+/**********************************************************************************
+ *
+ * FILE:            node_pool.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Owner of every DimensionNode of the ETS.
+ *
+ * Nodes are handed out from contiguous blocks instead of being allocated one by one,
+ * and they are released all together when the pool is destroyed. Since a node never
+ * moves once handed out, the threads can keep plain pointers to it.
+ *
+ * When the number of nodes is known beforehand (bulk-load mode), reserve() allocates
+ * a single block for all of them.
+ *
+ * Nodes given back with release() (the middle of a spilled package thread, see
+ * spill_store.hpp) are kept in a free list and handed out again before the
+ * current block is used, so the blocks only grow with the nodes in use.
+ *
+ * The memory of the nodes is kept in running counters instead of being measured
+ * on demand: the blocks are counted as they are added, and every dimension table
+ * adds its bytes to _tableBytes and keeps them up to date as it grows (see
+ * Hash::trackBytes), so memoryUsage() costs the same however many nodes there are.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef NODE_POOL_HPP
+#define NODE_POOL_HPP
+
+#include "array_list.hpp"
+#include "dimension_node.hpp"
+
+
+
+
+template <typename T>
+class NodePool
+{
+    private:
+        ArrayList<DimensionNode<T>*> _blocks;
+        ArrayList<DimensionNode<T>*> _free;
+        int _blockSize;
+        int _blockUsed;
+        int _blockCapacity;
+        int _size;
+        // Nodes in every block, and the bytes of their dimension tables
+        size_t _capacity;
+        size_t _tableBytes;
+        // Bytes of the table of a node not handed out, which is always a fresh one
+        size_t _freshTableBytes;
+
+        void addBlock(int capacity);
+
+    public:
+        explicit NodePool(int blockSize = 1024);
+        ~NodePool();
+        NodePool(const NodePool<T>& other) = delete;
+        NodePool<T>& operator=(const NodePool<T>& other) = delete;
+
+        // Guarantees room for count more nodes in the current block
+        void reserve(int count);
+        DimensionNode<T>* allocate();
+        // The node must no longer be linked in any dimension
+        void release(DimensionNode<T>* node);
+        // Nodes currently handed out
+        int getSize() const { return _size; };
+        // Nodes that still fit without a new block, free list included
+        int getSpare() const { return _free.getSize() + _blockCapacity - _blockUsed; };
+
+        /* Every node of every block with its dimension table, read from the running
+        *  counters; the nodes not handed out are not in use.
+        */
+        MemoryUsage memoryUsage() const;
+};
+
+
+
+
+template <typename T>
+NodePool<T>::NodePool(int blockSize)
+    : _blocks(16), _free(16), _blockSize(blockSize), _blockUsed(0), _blockCapacity(0), _size(0),
+      _capacity(0), _tableBytes(0), _freshTableBytes(DimensionNode<T>().dimension.memoryUsage().bytes) {}
+
+
+
+
+template <typename T>
+NodePool<T>::~NodePool() {
+    for (int i = 0; i < _blocks.getSize(); i++)
+        delete[] _blocks[i];
+}
+
+
+
+
+template <typename T>
+void NodePool<T>::addBlock(int capacity) {
+    DimensionNode<T>* block = new DimensionNode<T>[capacity];
+    for (int n = 0; n < capacity; n++)
+        block[n].dimension.trackBytes(&_tableBytes);
+
+    _blocks.insertAtEnd(block);
+    _blockUsed = 0;
+    _blockCapacity = capacity;
+    _capacity += capacity;
+}
+
+
+
+
+template <typename T>
+void NodePool<T>::reserve(int count) {
+    if (_blockCapacity - _blockUsed >= count) return;
+    addBlock(count);
+}
+
+
+
+
+template <typename T>
+DimensionNode<T>* NodePool<T>::allocate() {
+    _size++;
+    if (!_free.isEmpty()) return _free.removeFromPosition(_free.getSize() - 1);
+
+    if (_blockUsed == _blockCapacity) addBlock(_blockSize);
+    return &_blocks[_blocks.getSize() - 1][_blockUsed++];
+}
+
+
+
+
+template <typename T>
+MemoryUsage NodePool<T>::memoryUsage() const {
+    MemoryUsage usage = _blocks.memoryUsage();
+    usage += _free.memoryUsage();
+
+    usage.bytes += _capacity * sizeof(DimensionNode<T>) + _tableBytes;
+    usage.usedBytes += _size * sizeof(DimensionNode<T>) + _tableBytes - (_capacity - _size) * _freshTableBytes;
+    return usage;
+}
+
+
+
+
+template <typename T>
+void NodePool<T>::release(DimensionNode<T>* node) {
+    // Back to a fresh node: its dimension table is replaced by an empty one, counted anew
+    node->dimension.trackBytes(nullptr);
+    *node = DimensionNode<T>();
+    node->dimension.trackBytes(&_tableBytes);
+    _free.insertAtEnd(node);
+    _size--;
+}
+
+
+
+
+#endif
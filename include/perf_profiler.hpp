@@ -0,0 +1,294 @@
+/**********************************************************************************
+ *
+ * FILE:            perf_profiler.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Opt-in profiler that attributes hardware events to regions of the code: the
+ * handler of each command type and the update functions of the ETS.
+ *
+ * A group of four counters (cycles, instructions, last-level cache misses and
+ * branch misses) is opened with perf_event_open for each thread that profiles a
+ * region, user space only, the first time it does, and read as one group when a
+ * ProfileScope starts and when it ends; the difference is added to the totals of
+ * its region, along with the elapsed time. A group only counts its own thread, so
+ * the regions run by the event thread of the scheduler or by the workers of the
+ * thread pool get their own events, not those of the main thread. Scopes may
+ * nest, and a nested region is also counted in the enclosing one.
+ *
+ * Each read is a system call, so the profiled run is slower than a normal one;
+ * only the proportions between regions are meaningful. Where the counters are not
+ * available (perf_event_paranoid, containers, virtual machines without a PMU) the
+ * profiler still counts the calls and the time of each region; calls made on a
+ * thread whose group could not be opened are left out of the counter averages.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef PERF_PROFILER_HPP
+#define PERF_PROFILER_HPP
+
+#include "array_list.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+
+
+const int PERF_COUNTER_COUNT = 4;
+
+
+
+// Totals of one region; the counters only add up the calls in countedCalls
+struct ProfileTotals {
+    long calls = 0;
+    uint64_t nanoseconds = 0;
+    long countedCalls = 0;
+    uint64_t counters[PERF_COUNTER_COUNT] = {};
+};
+
+
+
+// A reading of the group of a thread: the counters, if it has them, and the time it was taken
+struct ProfileSample {
+    uint64_t counters[PERF_COUNTER_COUNT] = {};
+    bool counted = false;
+    uint64_t nanoseconds = 0;
+};
+
+
+
+// The counter group of one thread
+class CounterGroup
+{
+    private:
+        int _fds[PERF_COUNTER_COUNT];
+        bool _tried;
+
+    public:
+        CounterGroup();
+        ~CounterGroup();
+        CounterGroup(const CounterGroup& other) = delete;
+        CounterGroup& operator=(const CounterGroup& other) = delete;
+
+        // Opens the group for the calling thread, only the first time it is asked to
+        bool open();
+        bool read(uint64_t counters[]) const;
+};
+
+
+
+
+class PerfProfiler
+{
+    private:
+        bool _enabled;
+        bool _counters;
+        ArrayList<ProfileTotals> _totals;
+        // Regions may end on several threads at once
+        std::mutex _mutex;
+
+        // Group of the calling thread, closed when the thread ends
+        static CounterGroup& threadGroup();
+
+    public:
+        PerfProfiler();
+        PerfProfiler(const PerfProfiler& other) = delete;
+        PerfProfiler& operator=(const PerfProfiler& other) = delete;
+
+        /* Starts profiling regions [0, regions); returns false if the hardware
+        *  counters could not be opened for the calling thread, in which case only
+        *  calls and time are kept, on every thread.
+        */
+        bool open(int regions);
+        bool enabled() const { return _enabled; };
+        bool hasCounters() const { return _counters; };
+
+        void sample(ProfileSample& sample) const;
+        void add(int region, const ProfileSample& begin, const ProfileSample& end);
+        const ProfileTotals& totals(int region) const { return _totals[region]; };
+        int getSize() const { return _totals.getSize(); };
+};
+
+
+
+// Profiles its own lifetime, or until stop(), as one call of a region
+class ProfileScope
+{
+    private:
+        PerfProfiler& _profiler;
+        int _region;
+        bool _running;
+        ProfileSample _begin;
+
+    public:
+        ProfileScope(PerfProfiler& profiler, int region);
+        ~ProfileScope() { stop(); };
+        ProfileScope(const ProfileScope& other) = delete;
+        ProfileScope& operator=(const ProfileScope& other) = delete;
+
+        void stop();
+};
+
+
+
+
+CounterGroup::CounterGroup() : _tried(false) {
+    for (int k = 0; k < PERF_COUNTER_COUNT; k++) _fds[k] = -1;
+}
+
+
+
+
+CounterGroup::~CounterGroup() {
+    for (int k = 0; k < PERF_COUNTER_COUNT; k++)
+        if (_fds[k] >= 0) close(_fds[k]);
+}
+
+
+
+
+bool CounterGroup::open() {
+    if (_tried) return _fds[0] >= 0;
+    _tried = true;
+
+    const uint64_t configs[PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int k = 0; k < PERF_COUNTER_COUNT; k++) {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = configs[k];
+        attributes.read_format = PERF_FORMAT_GROUP;
+        attributes.disabled = (k == 0);
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        // pid 0 and cpu -1: the calling thread, wherever it runs
+        _fds[k] = syscall(SYS_perf_event_open, &attributes, 0, -1, (k == 0) ? -1 : _fds[0], 0);
+        if (_fds[k] >= 0) continue;
+
+        // All or nothing: a partial group would not be read as one
+        for (int opened = 0; opened < k; opened++) {
+            close(_fds[opened]);
+            _fds[opened] = -1;
+        }
+        return false;
+    }
+
+    ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+
+
+
+bool CounterGroup::read(uint64_t counters[]) const {
+    if (_fds[0] < 0) return false;
+
+    // PERF_FORMAT_GROUP: the number of counters, then their values
+    uint64_t values[1 + PERF_COUNTER_COUNT];
+    if (::read(_fds[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) return false;
+    for (int k = 0; k < PERF_COUNTER_COUNT; k++) counters[k] = values[1 + k];
+    return true;
+}
+
+
+
+
+PerfProfiler::PerfProfiler() : _enabled(false), _counters(false), _totals(0) {}
+
+
+
+
+CounterGroup& PerfProfiler::threadGroup() {
+    static thread_local CounterGroup group;
+    return group;
+}
+
+
+
+
+bool PerfProfiler::open(int regions) {
+    _enabled = true;
+    _totals.assign(regions, ProfileTotals());
+    _counters = threadGroup().open();
+    return _counters;
+}
+
+
+
+
+void PerfProfiler::sample(ProfileSample& sample) const {
+    sample.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!_counters) return;
+
+    CounterGroup& group = threadGroup();
+    sample.counted = group.open() && group.read(sample.counters);
+}
+
+
+
+
+void PerfProfiler::add(int region, const ProfileSample& begin, const ProfileSample& end) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ProfileTotals& totals = _totals[region];
+    totals.calls++;
+    totals.nanoseconds += end.nanoseconds - begin.nanoseconds;
+    if (!begin.counted || !end.counted) return;
+
+    totals.countedCalls++;
+    for (int k = 0; k < PERF_COUNTER_COUNT; k++)
+        totals.counters[k] += end.counters[k] - begin.counters[k];
+}
+
+
+
+
+ProfileScope::ProfileScope(PerfProfiler& profiler, int region)
+    : _profiler(profiler), _region(region), _running(profiler.enabled()) {
+    if (_running) _profiler.sample(_begin);
+}
+
+
+
+
+void ProfileScope::stop() {
+    if (!_running) return;
+    _running = false;
+
+    ProfileSample end;
+    _profiler.sample(end);
+    _profiler.add(_region, _begin, end);
+}
+
+
+
+
+#endif
@@ -0,0 +1,126 @@
+/**********************************************************************************
+ *
+ * FILE:            query_cache.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Bounded cache of rendered query answers.
+ *
+ * Every thread of the ETS carries a version that the list update functions bump
+ * whenever they touch it, so a cached answer is valid exactly while the version it
+ * was rendered from is still the current one. Invalidating therefore costs a single
+ * increment at update time, and stale entries are simply overwritten later.
+ *
+ * The cache is direct-mapped: each key has one slot, chosen by its hash, so its
+ * size never exceeds the number of slots given at construction.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef QUERY_CACHE_HPP
+#define QUERY_CACHE_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+
+#include <string>
+
+
+
+
+template <typename KeyType, typename HasherType = Hasher<KeyType>>
+class QueryCache
+{
+    private:
+        struct CacheSlot {
+            bool valid = false;
+            KeyType key;
+            unsigned int version = 0;
+            std::string body;
+        };
+
+        ArrayList<CacheSlot> _slots;
+        HasherType _hasher;
+
+    public:
+        // With no slots the cache is disabled: nothing is found nor stored
+        explicit QueryCache(int slots = 0) : _slots(0) { _slots.assign(slots, CacheSlot()); };
+
+        const std::string* find(const KeyType& key, unsigned int version) const;
+        void store(const KeyType& key, unsigned int version, const std::string& body);
+        bool enabled() const { return _slots.getSize() > 0; };
+
+        // Forgets every answer, releasing their memory, but keeps the slots
+        void clear();
+        MemoryUsage memoryUsage() const;
+};
+
+
+
+
+template <typename KeyType, typename HasherType>
+const std::string* QueryCache<KeyType, HasherType>::find(const KeyType& key, unsigned int version) const {
+    if (!enabled()) return nullptr;
+
+    const CacheSlot& slot = _slots[_hasher(key) % _slots.getSize()];
+    if (!slot.valid || slot.version != version || !(slot.key == key)) return nullptr;
+    return &slot.body;
+}
+
+
+
+
+template <typename KeyType, typename HasherType>
+void QueryCache<KeyType, HasherType>::store(const KeyType& key, unsigned int version, const std::string& body) {
+    if (!enabled()) return;
+
+    CacheSlot& slot = _slots[_hasher(key) % _slots.getSize()];
+    slot.valid = true;
+    slot.key = key;
+    slot.version = version;
+    slot.body = body;
+}
+
+
+
+
+template <typename KeyType, typename HasherType>
+void QueryCache<KeyType, HasherType>::clear() {
+    for (int k = 0; k < _slots.getSize(); k++)
+        _slots[k] = CacheSlot();
+}
+
+
+
+
+template <typename KeyType, typename HasherType>
+MemoryUsage QueryCache<KeyType, HasherType>::memoryUsage() const {
+    MemoryUsage usage;
+    usage.bytes = _slots.getSize() * sizeof(CacheSlot);
+    for (int k = 0; k < _slots.getSize(); k++) {
+        if (!_slots[k].valid) continue;
+        size_t bytes = heapBytes(_slots[k].key) + heapBytes(_slots[k].body);
+        usage.bytes += bytes;
+        usage.usedBytes += sizeof(CacheSlot) + bytes;
+    }
+    return usage;
+}
+
+
+
+
+#endif
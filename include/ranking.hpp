@@ -0,0 +1,268 @@
+/**********************************************************************************
+ *
+ * FILE:            ranking.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Counter per key kept in an indexed max-heap, so the keys with the highest
+ * counts are known at any time without scanning them all.
+ *
+ * Each key gets a handle, its entry in a dense array, which also records where
+ * the entry sits in the heap. Changing a count is then O(log n): the entry is
+ * sifted up or down from its own position, and callers that keep the handle skip
+ * the hash lookup of the key. Keys rank by count, and equal counts by key, so the
+ * order does not depend on the order the keys arrived in.
+ *
+ * top(k) reads the k best keys without touching the heap: a best-first walk that
+ * keeps the candidate positions in a small heap of their own, O(k log k).
+ *
+ * The heap is only built by the first top(), bottom-up in O(n). Until then a
+ * change of count is just the addition, so runs that never ask for a ranking do
+ * not pay for keeping one.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef RANKING_HPP
+#define RANKING_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+#include "utils.hpp"
+
+#include <utility>
+
+
+
+
+template <typename KeyType>
+struct RankingEntry {
+    KeyType key;
+    long count = 0;
+    // Where the entry sits in the heap
+    int position = -1;
+};
+
+
+
+
+template <typename KeyType>
+class Ranking
+{
+    private:
+        ArrayList<RankingEntry<KeyType>> _entries;
+        // Handles, as a max-heap
+        ArrayList<int> _heap;
+        Hash<KeyType, int> _handles;
+        // Whether _heap is kept in order, which it is from the first top() on
+        bool _ordered;
+
+        bool before(int a, int b) const;
+        void place(int position, int handle);
+        void siftUp(int position);
+        void siftDown(int position);
+        void order();
+
+    public:
+        explicit Ranking(int capacity = 1000);
+
+        // Handle of the key, which enters with a count of zero the first time
+        int handle(const KeyType& key);
+        void add(int handle, long delta);
+        // Room for count keys, so none of the arrays nor the table grows (bulk-load mode)
+        void reserve(int count);
+
+        const KeyType& key(int handle) const { return _entries[handle].key; };
+        long count(int handle) const { return _entries[handle].count; };
+        int getSize() const { return _entries.getSize(); };
+
+        // Handles of the (at most) k keys with the highest positive counts, best first
+        void top(int k, ArrayList<int>& handles);
+
+        MemoryUsage memoryUsage() const;
+};
+
+
+
+
+template <typename KeyType>
+Ranking<KeyType>::Ranking(int capacity) : _entries(capacity), _heap(capacity), _handles(capacity), _ordered(false) {}
+
+
+
+
+template <typename KeyType>
+bool Ranking<KeyType>::before(int a, int b) const {
+    const RankingEntry<KeyType>& first = _entries[a];
+    const RankingEntry<KeyType>& second = _entries[b];
+    if (first.count != second.count) return first.count > second.count;
+    return first.key < second.key;
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::place(int position, int handle) {
+    _heap[position] = handle;
+    _entries[handle].position = position;
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::siftUp(int position) {
+    int handle = _heap[position];
+    while (position > 0 && before(handle, _heap[(position - 1) / 2])) {
+        place(position, _heap[(position - 1) / 2]);
+        position = (position - 1) / 2;
+    }
+    place(position, handle);
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::siftDown(int position) {
+    int handle = _heap[position];
+    while (true) {
+        int best = -1;
+        for (int child = 2 * position + 1; child <= 2 * position + 2 && child < _heap.getSize(); child++)
+            if (before(_heap[child], (best < 0) ? handle : _heap[best])) best = child;
+        if (best < 0) break;
+
+        place(position, _heap[best]);
+        position = best;
+    }
+    place(position, handle);
+}
+
+
+
+
+template <typename KeyType>
+int Ranking<KeyType>::handle(const KeyType& key) {
+    // A single probe: operator[] inserts the key when it is missing
+    size_t known = _handles.size();
+    int& slot = _handles[key];
+    if (_handles.size() == known) return slot;
+
+    int handle = _entries.getSize();
+    slot = handle;
+    RankingEntry<KeyType> entry;
+    entry.key = key;
+    _entries.insertAtEnd(entry);
+    _heap.insertAtEnd(handle);
+    _entries[handle].position = _heap.getSize() - 1;
+    if (_ordered) siftUp(_heap.getSize() - 1);
+    return handle;
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::reserve(int count) {
+    _entries.reserve(count);
+    _heap.reserve(count);
+    _handles.reserve(count);
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::add(int handle, long delta) {
+    _entries[handle].count += delta;
+    if (!_ordered) return;
+    if (delta > 0) siftUp(_entries[handle].position);
+    else siftDown(_entries[handle].position);
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::order() {
+    for (int position = _heap.getSize() / 2 - 1; position >= 0; position--) siftDown(position);
+    _ordered = true;
+}
+
+
+
+
+template <typename KeyType>
+void Ranking<KeyType>::top(int k, ArrayList<int>& handles) {
+    handles.clear();
+    if (k <= 0 || _heap.isEmpty()) return;
+    if (!_ordered) order();
+
+    // Heap positions whose parent was already taken, as a heap of their own
+    ArrayList<int> candidates(k + 2);
+    auto better = [&](int a, int b) { return before(_heap[candidates[a]], _heap[candidates[b]]); };
+    candidates.insertAtEnd(0);
+
+    while (handles.getSize() < k && !candidates.isEmpty()) {
+        int position = candidates[0];
+        if (_entries[_heap[position]].count <= 0) break;
+        handles.insertAtEnd(_heap[position]);
+
+        // Pops the best candidate...
+        candidates[0] = candidates[candidates.getSize() - 1];
+        candidates.removeFromPosition(candidates.getSize() - 1);
+        for (int c = 0; 2 * c + 1 < candidates.getSize();) {
+            int child = 2 * c + 1;
+            if (child + 1 < candidates.getSize() && better(child + 1, child)) child++;
+            if (!better(child, c)) break;
+            std::swap(candidates[c], candidates[child]);
+            c = child;
+        }
+
+        // ...and pushes the children of its position
+        for (int child = 2 * position + 1; child <= 2 * position + 2 && child < _heap.getSize(); child++) {
+            candidates.insertAtEnd(child);
+            for (int c = candidates.getSize() - 1; c > 0 && better(c, (c - 1) / 2); c = (c - 1) / 2)
+                std::swap(candidates[c], candidates[(c - 1) / 2]);
+        }
+    }
+}
+
+
+
+
+template <typename KeyType>
+MemoryUsage Ranking<KeyType>::memoryUsage() const {
+    MemoryUsage usage = _entries.memoryUsage();
+    usage += _heap.memoryUsage();
+    usage += _handles.memoryUsage();
+    return usage;
+}
+
+
+
+
+template <typename KeyType>
+size_t heapBytes(const RankingEntry<KeyType>& entry) {
+    return heapBytes(entry.key);
+}
+
+
+
+
+#endif
@@ -0,0 +1,515 @@
+/**********************************************************************************
+ *
+ * FILE:            replica_region.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * POSIX shared-memory region through which the ingest process publishes a frozen
+ * snapshot of the ETS, so that other processes can answer CL, PC, CW and PW from
+ * it without replaying the trace: they all map the same pages, so the memory of
+ * the snapshot is paid for once, however many readers are attached.
+ *
+ * Pointers mean nothing in another address space, so everything in the region is
+ * linked by offsets and indexes:
+ *
+ *  header | records | names | chars | customer slots | package slots | items
+ *
+ * - records: one fixed-size ReplicaRecord per command index, decoded from the
+ *   EventLog. They never move, so each publication only writes the new ones.
+ * - names/chars: the interned customer names, referenced by id from the records.
+ * - slots: open-addressing tables (linear probing) from a customer name id or a
+ *   package id to a row of the items, laid out as in csr_index.hpp.
+ * - items: the command indexes of every customer and package thread.
+ *
+ * Consistency follows a seqlock: the writer makes the sequence odd while it
+ * publishes and even again when it is done, and a reader retries whatever it read
+ * unless the sequence was the same even value before and after. Every offset read
+ * by a reader is checked against its mapping, so a torn read can only produce a
+ * wrong answer, which is then discarded. The region only grows; readers remap it
+ * when they see the new size in the header.
+ *
+ * The region outlives the writer, so readers can keep attaching to the last
+ * snapshot; a new writer with the same name unlinks it and starts a new one,
+ * leaving the readers still mapping the old one undisturbed.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef REPLICA_REGION_HPP
+#define REPLICA_REGION_HPP
+
+#include "csr_index.hpp"
+#include "event_log.hpp"
+#include "hash.hpp"
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+
+const unsigned int REPLICA_MAGIC = 0x45545352;
+
+
+
+struct ReplicaHeader {
+    std::atomic<size_t> sequence;
+    unsigned int magic;
+    // Number of snapshots published so far
+    unsigned int generation;
+    size_t size;
+    int recordCapacity;
+    int recordCount;
+    size_t namesOffset;
+    int nameCount;
+    size_t charsOffset;
+    size_t charsSize;
+    size_t customerSlotsOffset;
+    int customerSlotCount;
+    size_t packageSlotsOffset;
+    int packageSlotCount;
+    size_t itemsOffset;
+    int itemCount;
+};
+
+
+
+// A command as stored in the region; sender and recipient are name ids, or -1.
+// The stakeholder of an ST record is kept in sender.
+struct ReplicaRecord {
+    int time;
+    int type;
+    int packageId;
+    int origin;
+    int destination;
+    int section;
+    int sender;
+    int recipient;
+};
+
+
+
+struct ReplicaName {
+    int offset;
+    int length;
+};
+
+
+
+// Row of the items owned by a key: a customer name id or a package id
+struct ReplicaSlot {
+    int used;
+    int key;
+    int begin;
+    int size;
+};
+
+
+
+
+class ReplicaRegion
+{
+    private:
+        int _fd;
+        char* _base;
+        size_t _size;
+        bool _writer;
+
+        ReplicaHeader* header() const { return reinterpret_cast<ReplicaHeader*>(_base); };
+        bool grow(size_t minimum);
+        bool remap();
+        // Start of count objects of type T at offset, or nullptr if they fall off the mapping
+        template <typename T>
+        const T* at(size_t offset, size_t count) const;
+        bool nameEquals(int id, const std::string& name) const;
+        CsrSpan row(const ReplicaSlot* slots, int slotCount, size_t hash, int key, const std::string* name) const;
+        size_t writeTables(const EventLog& logs, const CsrIndex<std::string>& customers, const CsrIndex<int>& packages, bool sizeOnly);
+
+    public:
+        ReplicaRegion();
+        ~ReplicaRegion();
+        ReplicaRegion(const ReplicaRegion& other) = delete;
+        ReplicaRegion& operator=(const ReplicaRegion& other) = delete;
+
+        // Writer: replaces any region with that name by an empty one
+        bool create(const char* name);
+        bool enabled() const { return _fd >= 0; };
+        // Publishes the log and the frozen threads, which must describe the same state
+        bool publish(const EventLog& logs, const CsrIndex<std::string>& customers, const CsrIndex<int>& packages);
+
+        // Reader: maps an existing region read-only
+        bool attach(const char* name);
+        // Waits out a publication and returns the sequence the read must end with
+        size_t beginRead();
+        bool endRead(size_t sequence) const;
+        // Rows are empty when the key is unknown; their items are command indexes
+        CsrSpan customerRow(const std::string& name) const;
+        CsrSpan packageRow(int packageId) const;
+        // Decodes command i; false if it is not in the region (only after a torn read)
+        bool command(int i, Command& command) const;
+        // Narrows the row to the commands with time in [windowBegin, windowEnd]
+        bool window(CsrSpan& span, int windowBegin, int windowEnd) const;
+};
+
+
+
+
+ReplicaRegion::ReplicaRegion() : _fd(-1), _base(nullptr), _size(0), _writer(false) {}
+
+
+
+
+ReplicaRegion::~ReplicaRegion() {
+    if (_base != nullptr) munmap(_base, _size);
+    if (_fd >= 0) close(_fd);
+}
+
+
+
+
+bool ReplicaRegion::create(const char* name) {
+    shm_unlink(name);
+    _fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (_fd < 0) return false;
+    _writer = true;
+
+    if (!grow(1 << 20)) {
+        close(_fd);
+        _fd = -1;
+        shm_unlink(name);
+        return false;
+    }
+    new (header()) ReplicaHeader();
+    header()->sequence.store(0);
+    header()->magic = REPLICA_MAGIC;
+    header()->size = _size;
+    return true;
+}
+
+
+
+// Grows the object and the mapping, doubling it; the mapping may move
+bool ReplicaRegion::grow(size_t minimum) {
+    size_t size = (_size > 0) ? _size : minimum;
+    while (size < minimum) size *= 2;
+    if (size == _size) return true;
+
+    if (ftruncate(_fd, size) != 0) return false;
+    void* mapping = (_base == nullptr)
+        ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0)
+        : mremap(_base, _size, size, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) return false;
+
+    _base = static_cast<char*>(mapping);
+    _size = size;
+    return true;
+}
+
+
+
+
+bool ReplicaRegion::attach(const char* name) {
+    _fd = shm_open(name, O_RDONLY, 0);
+    if (_fd < 0) return false;
+
+    if (remap() && header()->magic == REPLICA_MAGIC) return true;
+    if (_base != nullptr) munmap(_base, _size);
+    _base = nullptr;
+    close(_fd);
+    _fd = -1;
+    return false;
+}
+
+
+
+// Maps the whole object again, at its current size
+bool ReplicaRegion::remap() {
+    struct stat info;
+    if (fstat(_fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(ReplicaHeader)) return false;
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (mapping == MAP_FAILED) return false;
+    if (_base != nullptr) munmap(_base, _size);
+    _base = static_cast<char*>(mapping);
+    _size = info.st_size;
+    return true;
+}
+
+
+
+
+size_t ReplicaRegion::beginRead() {
+    while (true) {
+        size_t sequence = header()->sequence.load(std::memory_order_acquire);
+        if (sequence % 2 == 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (header()->size > _size && !remap()) continue;
+        return sequence;
+    }
+}
+
+
+
+
+bool ReplicaRegion::endRead(size_t sequence) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header()->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+
+
+
+template <typename T>
+const T* ReplicaRegion::at(size_t offset, size_t count) const {
+    if (offset > _size || count > (_size - offset) / sizeof(T)) return nullptr;
+    return reinterpret_cast<const T*>(_base + offset);
+}
+
+
+
+
+bool ReplicaRegion::nameEquals(int id, const std::string& name) const {
+    const ReplicaHeader* region = header();
+    if (id < 0 || id >= region->nameCount) return false;
+    const ReplicaName* names = at<ReplicaName>(region->namesOffset, region->nameCount);
+    if (names == nullptr || names[id].offset < 0 || names[id].length < 0 || static_cast<size_t>(names[id].offset) + names[id].length > region->charsSize) return false;
+    const char* chars = at<char>(region->charsOffset, region->charsSize);
+    return chars != nullptr && name.size() == static_cast<size_t>(names[id].length)
+        && memcmp(chars + names[id].offset, name.data(), name.size()) == 0;
+}
+
+
+
+// Probes the slots from the home of hash until the key (or the name, for customers) or an empty slot
+CsrSpan ReplicaRegion::row(const ReplicaSlot* slots, int slotCount, size_t hash, int key, const std::string* name) const {
+    if (slots == nullptr || slotCount <= 0) return CsrSpan();
+
+    for (int probe = 0, slot = hash % slotCount; probe < slotCount; probe++, slot = (slot + 1) % slotCount) {
+        if (!slots[slot].used) break;
+        bool match = (name != nullptr) ? nameEquals(slots[slot].key, *name) : slots[slot].key == key;
+        if (!match) continue;
+
+        const int* items = at<int>(header()->itemsOffset, header()->itemCount);
+        if (items == nullptr || slots[slot].begin < 0 || slots[slot].size < 0
+            || slots[slot].begin > header()->itemCount - slots[slot].size) return CsrSpan();
+        return CsrSpan(items + slots[slot].begin, slots[slot].size);
+    }
+    return CsrSpan();
+}
+
+
+
+
+CsrSpan ReplicaRegion::customerRow(const std::string& name) const {
+    const ReplicaHeader* region = header();
+    const ReplicaSlot* slots = at<ReplicaSlot>(region->customerSlotsOffset, region->customerSlotCount);
+    return row(slots, region->customerSlotCount, Hasher<std::string>()(name), 0, &name);
+}
+
+
+
+
+CsrSpan ReplicaRegion::packageRow(int packageId) const {
+    const ReplicaHeader* region = header();
+    const ReplicaSlot* slots = at<ReplicaSlot>(region->packageSlotsOffset, region->packageSlotCount);
+    return row(slots, region->packageSlotCount, Hasher<int>()(packageId), packageId, nullptr);
+}
+
+
+
+
+bool ReplicaRegion::command(int i, Command& command) const {
+    const ReplicaHeader* region = header();
+    if (i < 0 || i >= region->recordCount) return false;
+    const ReplicaRecord* record = at<ReplicaRecord>(sizeof(ReplicaHeader) + i * sizeof(ReplicaRecord), 1);
+    if (record == nullptr) return false;
+
+    command = Command();
+    command.time = record->time;
+    command.type = static_cast<CommandType>(record->type);
+    command.packageId = record->packageId;
+    command.originWarehouseId = record->origin;
+    command.destinationWarehouseId = record->destination;
+    command.targetSection = record->section;
+
+    // Only RG and ST records carry names
+    if (command.type != CommandType::RG && command.type != CommandType::ST) return true;
+    const ReplicaName* names = at<ReplicaName>(region->namesOffset, region->nameCount);
+    const char* chars = at<char>(region->charsOffset, region->charsSize);
+    int ids[2] = { record->sender, record->recipient };
+    std::string* fields[2] = { &command.sender, &command.recipient };
+    if (command.type == CommandType::ST) fields[0] = &command.customerName;
+    int count = (command.type == CommandType::ST) ? 1 : 2;
+    for (int k = 0; k < count; k++) {
+        if (names == nullptr || chars == nullptr || ids[k] < 0 || ids[k] >= region->nameCount) return false;
+        const ReplicaName& entry = names[ids[k]];
+        if (entry.offset < 0 || entry.length < 0 || static_cast<size_t>(entry.offset) + entry.length > region->charsSize) return false;
+        fields[k]->assign(chars + entry.offset, entry.length);
+    }
+    return true;
+}
+
+
+
+// Rows are chronological, so the window is found by two binary searches on the record times
+bool ReplicaRegion::window(CsrSpan& span, int windowBegin, int windowEnd) const {
+    Command event;
+    int bounds[2];
+    for (int side = 0; side < 2; side++) {
+        int low = 0, high = span.size;
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            if (!command(span.items[middle], event)) return false;
+            bool before = (side == 0) ? event.time < windowBegin : event.time <= windowEnd;
+            if (before) low = middle + 1;
+            else high = middle;
+        }
+        bounds[side] = low;
+    }
+
+    span = CsrSpan(span.items + bounds[0], (bounds[1] > bounds[0]) ? bounds[1] - bounds[0] : 0);
+    return true;
+}
+
+
+
+
+/* Lays out every section after the records and returns the size of the region.
+*  With sizeOnly nothing is written, which is how publish() learns how far to grow.
+*/
+size_t ReplicaRegion::writeTables(const EventLog& logs, const CsrIndex<std::string>& customers, const CsrIndex<int>& packages, bool sizeOnly) {
+    auto align = [](size_t offset) { return (offset + 7) & ~static_cast<size_t>(7); };
+    ReplicaHeader* region = header();
+    int customerSlotCount = 2 * customers.rowCount() + 1;
+    int packageSlotCount = 2 * packages.rowCount() + 1;
+
+    size_t charsSize = 0;
+    for (int id = 0; id < logs.customerCount(); id++) charsSize += logs.customerName(id).size();
+
+    size_t namesOffset = sizeof(ReplicaHeader) + static_cast<size_t>(region->recordCapacity) * sizeof(ReplicaRecord);
+    size_t charsOffset = align(namesOffset + logs.customerCount() * sizeof(ReplicaName));
+    size_t customerSlotsOffset = align(charsOffset + charsSize);
+    size_t packageSlotsOffset = customerSlotsOffset + customerSlotCount * sizeof(ReplicaSlot);
+    size_t itemsOffset = packageSlotsOffset + packageSlotCount * sizeof(ReplicaSlot);
+    int itemCount = customers.itemCount() + packages.itemCount();
+    size_t size = itemsOffset + itemCount * sizeof(int);
+    if (sizeOnly) return size;
+
+    ReplicaName* names = reinterpret_cast<ReplicaName*>(_base + namesOffset);
+    char* chars = _base + charsOffset;
+    int offset = 0;
+    for (int id = 0; id < logs.customerCount(); id++) {
+        const std::string& name = logs.customerName(id);
+        names[id].offset = offset;
+        names[id].length = name.size();
+        memcpy(chars + offset, name.data(), name.size());
+        offset += name.size();
+    }
+
+    ReplicaSlot* customerSlots = reinterpret_cast<ReplicaSlot*>(_base + customerSlotsOffset);
+    ReplicaSlot* packageSlots = reinterpret_cast<ReplicaSlot*>(_base + packageSlotsOffset);
+    int* items = reinterpret_cast<int*>(_base + itemsOffset);
+    memset(customerSlots, 0, (customerSlotCount + packageSlotCount) * sizeof(ReplicaSlot));
+
+    int next = 0;
+    auto place = [&](ReplicaSlot* slots, int slotCount, size_t hash, int key, CsrSpan span) {
+        int slot = hash % slotCount;
+        while (slots[slot].used) slot = (slot + 1) % slotCount;
+        slots[slot].used = 1;
+        slots[slot].key = key;
+        slots[slot].begin = next;
+        slots[slot].size = span.size;
+        memcpy(items + next, span.items, span.size * sizeof(int));
+        next += span.size;
+    };
+    customers.forEachRow([&](const std::string& name, CsrSpan span) {
+        int id = logs.findCustomer(name);
+        if (id >= 0) place(customerSlots, customerSlotCount, Hasher<std::string>()(name), id, span);
+    });
+    packages.forEachRow([&](const int& packageId, CsrSpan span) {
+        place(packageSlots, packageSlotCount, Hasher<int>()(packageId), packageId, span);
+    });
+
+    region->namesOffset = namesOffset;
+    region->nameCount = logs.customerCount();
+    region->charsOffset = charsOffset;
+    region->charsSize = charsSize;
+    region->customerSlotsOffset = customerSlotsOffset;
+    region->customerSlotCount = customerSlotCount;
+    region->packageSlotsOffset = packageSlotsOffset;
+    region->packageSlotCount = packageSlotCount;
+    region->itemsOffset = itemsOffset;
+    region->itemCount = next;
+    return size;
+}
+
+
+
+
+bool ReplicaRegion::publish(const EventLog& logs, const CsrIndex<std::string>& customers, const CsrIndex<int>& packages) {
+    if (!_writer) return false;
+
+    // Room for the records first, which fixes where the other sections begin
+    int recordCapacity = header()->recordCapacity;
+    if (recordCapacity < logs.getSize()) recordCapacity = (2 * recordCapacity > logs.getSize()) ? 2 * recordCapacity : logs.getSize();
+    int oldCapacity = header()->recordCapacity;
+
+    header()->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header()->recordCapacity = recordCapacity;
+    size_t size = writeTables(logs, customers, packages, true);
+    if (!grow(size)) {
+        header()->recordCapacity = oldCapacity;
+        header()->sequence.fetch_add(1, std::memory_order_release);
+        return false;
+    }
+
+    ReplicaRecord* records = reinterpret_cast<ReplicaRecord*>(_base + sizeof(ReplicaHeader));
+    logs.forEach(header()->recordCount, logs.getSize(), [&](int i, const Command& command, const int customerIds[2]) {
+        ReplicaRecord& record = records[i];
+        record.time = command.time;
+        record.type = static_cast<int>(command.type);
+        record.packageId = command.packageId;
+        record.origin = command.originWarehouseId;
+        record.destination = command.destinationWarehouseId;
+        record.section = command.targetSection;
+        record.sender = (command.type == CommandType::RG || command.type == CommandType::ST) ? customerIds[0] : -1;
+        record.recipient = (command.type == CommandType::RG) ? customerIds[1] : -1;
+    });
+    header()->recordCount = logs.getSize();
+    writeTables(logs, customers, packages, false);
+    header()->size = _size;
+    header()->generation++;
+
+    header()->sequence.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+
+
+
+#endif
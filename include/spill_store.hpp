@@ -0,0 +1,146 @@
+/**********************************************************************************
+ *
+ * FILE:            spill_store.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Append-only segment of a file, mapped in memory, where the package threads that
+ * have gone cold are kept as plain arrays of command indexes.
+ *
+ * A spilled thread keeps only its first and last nodes, which are the only ones
+ * the customer threads point to, so the CL answers never change. Its whole
+ * sequence of events is written here once, and PC reads it straight from the
+ * mapping. Being a shared file mapping, these pages belong to the page cache
+ * rather than to the heap, so the kernel writes them back to the disk and drops
+ * them under memory pressure.
+ *
+ * Spilled arrays are never rewritten: a package that receives a new event is
+ * rebuilt in memory and its old array is simply left behind.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef SPILL_STORE_HPP
+#define SPILL_STORE_HPP
+
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+
+
+// Where a spilled thread lies in the segment; offset -1 means not spilled
+struct SpillSpan {
+    long offset = -1;
+    int size = 0;
+};
+
+
+
+
+class SpillStore
+{
+    private:
+        int _fd;
+        int* _items;
+        size_t _capacity;
+        size_t _size;
+
+        bool grow(size_t minimum);
+
+    public:
+        SpillStore();
+        ~SpillStore();
+        SpillStore(const SpillStore& other) = delete;
+        SpillStore& operator=(const SpillStore& other) = delete;
+
+        // Creates (or truncates) the segment file; without it nothing is spilled
+        bool open(const char* path);
+        bool enabled() const { return _fd >= 0; };
+
+        // Appends the items and returns where they were written (offset -1 on failure)
+        SpillSpan write(const int* items, int count);
+        const int* items(SpillSpan span) const { return _items + span.offset; };
+        size_t getSize() const { return _size; };
+};
+
+
+
+
+SpillStore::SpillStore() : _fd(-1), _items(nullptr), _capacity(0), _size(0) {}
+
+
+
+
+SpillStore::~SpillStore() {
+    if (_items != nullptr) munmap(_items, _capacity * sizeof(int));
+    if (_fd >= 0) close(_fd);
+}
+
+
+
+
+bool SpillStore::open(const char* path) {
+    _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) return false;
+    if (grow(1 << 18)) return true;
+
+    close(_fd);
+    _fd = -1;
+    return false;
+}
+
+
+
+// Doubles the file and its mapping; the mapping may move, so no pointer survives it
+bool SpillStore::grow(size_t minimum) {
+    size_t capacity = (_capacity > 0) ? _capacity : minimum;
+    while (capacity < minimum) capacity *= 2;
+
+    if (ftruncate(_fd, capacity * sizeof(int)) != 0) return false;
+
+    void* mapping = (_items == nullptr)
+        ? mmap(nullptr, capacity * sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0)
+        : mremap(_items, _capacity * sizeof(int), capacity * sizeof(int), MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) return false;
+
+    _items = static_cast<int*>(mapping);
+    _capacity = capacity;
+    return true;
+}
+
+
+
+
+SpillSpan SpillStore::write(const int* items, int count) {
+    SpillSpan span;
+    if (!enabled()) return span;
+    if (_size + count > _capacity && !grow(_size + count)) return span;
+
+    for (int k = 0; k < count; k++) _items[_size + k] = items[k];
+    span.offset = static_cast<long>(_size);
+    span.size = count;
+    _size += count;
+    return span;
+}
+
+
+
+
+#endif
@@ -0,0 +1,151 @@
+/**********************************************************************************
+ *
+ * FILE:            thread_pool.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Fixed set of worker threads for fork-join work over a read-only ETS.
+ *
+ * run(count, job) calls job(0) ... job(count - 1) spread over the workers and the
+ * calling thread, and only returns once every call has finished, so whatever the
+ * jobs wrote is visible to the caller afterwards. The workers are created once and
+ * sleep between runs.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include "array_list.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+
+
+class ThreadPool
+{
+    private:
+        ArrayList<std::thread> _workers;
+        std::mutex _mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        std::function<void(int)> _job;
+        int _jobCount;
+        std::atomic<int> _nextJob;
+        int _running;
+        unsigned int _generation;
+        bool _stop;
+
+        void work();
+        void drain();
+
+    public:
+        // Creates threads - 1 workers: the caller of run is the last one
+        explicit ThreadPool(int threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool& other) = delete;
+        ThreadPool& operator=(const ThreadPool& other) = delete;
+
+        void run(int count, const std::function<void(int)>& job);
+        int getSize() const { return _workers.getSize() + 1; };
+};
+
+
+
+
+ThreadPool::ThreadPool(int threads)
+    : _workers(threads > 1 ? threads - 1 : 0), _jobCount(0), _nextJob(0), _running(0), _generation(0), _stop(false) {
+    for (int k = 0; k + 1 < threads; k++)
+        _workers.emplace_back(&ThreadPool::work, this);
+}
+
+
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _start.notify_all();
+    for (int k = 0; k < _workers.getSize(); k++)
+        _workers[k].join();
+}
+
+
+
+
+void ThreadPool::drain() {
+    for (int job = _nextJob.fetch_add(1); job < _jobCount; job = _nextJob.fetch_add(1))
+        _job(job);
+}
+
+
+
+
+void ThreadPool::work() {
+    unsigned int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) return;
+            seen = _generation;
+        }
+
+        drain();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_running == 0) _done.notify_one();
+    }
+}
+
+
+
+
+void ThreadPool::run(int count, const std::function<void(int)>& job) {
+    if (_workers.getSize() == 0 || count < 2) {
+        for (int k = 0; k < count; k++) job(k);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = job;
+        _jobCount = count;
+        _nextJob = 0;
+        _running = _workers.getSize();
+        _generation++;
+    }
+    _start.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [&] { return _running == 0; });
+}
+
+
+
+
+#endif
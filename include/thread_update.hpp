@@ -0,0 +1,107 @@
+/**********************************************************************************
+ *
+ * FILE:            thread_update.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * The node moves that keep the customer and package threads of the ETS up to date
+ * when an event arrives (see the description in main.cpp).
+ *
+ * They are kept apart from main.cpp so that the benchmark (bench/bench.cpp) runs
+ * exactly the code the logistics system runs, rather than a copy of it.
+ *
+ * Every move reaches the dimension tables of the nodes by the name of the thread.
+ * The callers pass the hash of the customer name along with it (see Hash::hashOf),
+ * computed once when the customer joined the package, so an update hashes no name.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef THREAD_UPDATE_HPP
+#define THREAD_UPDATE_HPP
+
+#include "dimension_node.hpp"
+#include "linked_list.hpp"
+
+#include <string>
+
+
+
+
+// Name of the package dimension, and its hash in the dimension tables
+const std::string PACKAGE_DIMENSION = "package";
+const size_t PACKAGE_DIMENSION_HASH = Hasher<std::string>()(PACKAGE_DIMENSION);
+
+
+
+// first is the node the package entered the customer thread with (DNode is null for that node itself)
+void updateCustomerList(const std::string& customer, size_t customerHash, DimensionNode<int>* DNode, DimensionNode<int>* newDNode, const DimensionNode<int>* first, LinkedList<int>* customerList) {
+    // Pointers of a node in this customer dimension
+    auto thread = [&](DimensionNode<int>* node) -> DimensionPointers<int>& {
+        return node->dimension.get(customer, customerHash);
+    };
+
+    if (customerList->tail == nullptr) { // Customer list is empty
+        // Add newDNode as the 1st element of the list
+        customerList->head = newDNode;
+        customerList->size = 1;
+    } else if (DNode == nullptr || DNode == first) { // 1st or 2nd event of the package in this thread
+        // As the 1st event cannot be deleted, in both conditions the new event is added to the end of the list
+        thread(customerList->tail).next = newDNode;
+        thread(newDNode).prev = customerList->tail;
+        customerList->size++;
+    } else {
+        DimensionPointers<int>& old = thread(DNode);
+        if (old.next == nullptr) {
+            // The new DNode replaces the old one
+            thread(old.prev).next = newDNode;
+            thread(newDNode).prev = old.prev;
+        } else { // Has a subsequent DNode
+            // It is necessary to delete the old DNode from the list and add the new one at the end;
+            thread(old.prev).next = old.next;
+            thread(old.next).prev = old.prev;
+            thread(customerList->tail).next = newDNode;
+            thread(newDNode).prev = customerList->tail;
+        }
+    }
+    customerList->tail = newDNode;
+    customerList->version++;
+};
+
+
+
+
+void updatePackageList(LinkedList<int>* packageList, DimensionNode<int>* newDNode) {
+    if (packageList->getSize() == 0) {
+        // Add as 1st element
+        packageList->head = newDNode;
+        packageList->tail = packageList->head;
+        packageList->size = 1;
+    } else {
+        // Add as last element
+        packageList->tail->dimension.get(PACKAGE_DIMENSION, PACKAGE_DIMENSION_HASH).next = newDNode;
+        newDNode->dimension.get(PACKAGE_DIMENSION, PACKAGE_DIMENSION_HASH).prev = packageList->tail;
+        packageList->tail = newDNode;
+        packageList->size++;
+    }
+    packageList->version++;
+};
+
+
+
+
+#endif
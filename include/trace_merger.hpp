@@ -0,0 +1,274 @@
+/**********************************************************************************
+ *
+ * FILE:            trace_merger.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Reads several trace files as if they were a single one, merged by time stamp.
+ *
+ * Each file is decoded by its own parser thread into chunks of MERGE_CHUNK
+ * commands, handed over one at a time (double buffering): while the merge consumes
+ * a chunk, the parser fills the next one. The merge itself is a k-way merge over a
+ * binary heap of the files, ordered by the time stamp of their next command and
+ * then by their position on the command line, so commands with the same time
+ * stamp keep the order of the files and, within a file, their own order. When
+ * every file is chronological the result is exactly a stable sort of their
+ * concatenation by time stamp, which is what the external tools used to produce.
+ *
+ * A single file is read directly, without any thread.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef TRACE_MERGER_HPP
+#define TRACE_MERGER_HPP
+
+#include "array_list.hpp"
+#include "trace_reader.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+
+
+
+const int MERGE_CHUNK = 4096;
+
+
+
+
+class TraceMerger
+{
+    private:
+        struct Source {
+            TraceReader reader;
+            // Chunk being merged
+            ArrayList<Command> current;
+            int currentSize = 0;
+            int position = 0;
+            // Chunk handed over by the parser; a short one is the last
+            ArrayList<Command> handoff;
+            int handoffSize = 0;
+            bool ready = false;
+            bool last = false;
+            // Asks the parser to give up, set under mutex like the handoff
+            bool stop = false;
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::thread parser;
+
+            // Both chunks keep MERGE_CHUNK commands, whose slots the parser reuses
+            Source() : current(0), handoff(0) {
+                current.assign(MERGE_CHUNK, Command());
+                handoff.assign(MERGE_CHUNK, Command());
+            };
+        };
+
+        ArrayList<Source*> _sources;
+        // Indexes of the sources with a command left, as a min-heap
+        ArrayList<int> _heap;
+        bool _started;
+
+        void start();
+        void parse(Source* source);
+        bool advance(Source* source);
+        bool before(int a, int b) const;
+        void siftDown(int position);
+        void siftUp(int position);
+
+    public:
+        TraceMerger();
+        ~TraceMerger();
+        TraceMerger(const TraceMerger& other) = delete;
+        TraceMerger& operator=(const TraceMerger& other) = delete;
+
+        // Adds a file to the merge; files must all be added before the first next()
+        bool open(const char* path, IoBackend backend = IoBackend::SYNC);
+        int getSize() const { return _sources.getSize(); };
+        // Sizes of all the files together (see TraceReader::scan); only before the first next()
+        TraceStats scan();
+        bool next(Command& command);
+};
+
+
+
+
+TraceMerger::TraceMerger() : _sources(4), _heap(4), _started(false) {}
+
+
+
+
+TraceMerger::~TraceMerger() {
+    for (int k = 0; k < _sources.getSize(); k++) {
+        std::lock_guard<std::mutex> lock(_sources[k]->mutex);
+        _sources[k]->stop = true;
+        _sources[k]->changed.notify_all();
+    }
+    for (int k = 0; k < _sources.getSize(); k++) {
+        if (_sources[k]->parser.joinable()) _sources[k]->parser.join();
+        delete _sources[k];
+    }
+}
+
+
+
+
+bool TraceMerger::open(const char* path, IoBackend backend) {
+    Source* source = new Source();
+    if (!source->reader.open(path, backend)) {
+        delete source;
+        return false;
+    }
+    _sources.insertAtEnd(source);
+    return true;
+}
+
+
+
+
+TraceStats TraceMerger::scan() {
+    TraceStats total;
+    for (int k = 0; k < _sources.getSize(); k++) {
+        // Keys shared by several files are counted once per file, which only oversizes
+        TraceStats stats = _sources[k]->reader.scan();
+        total.commands += stats.commands;
+        total.events += stats.events;
+        total.packages += stats.packages;
+        total.customers += stats.customers;
+    }
+    return total;
+}
+
+
+
+
+void TraceMerger::start() {
+    _started = true;
+    for (int k = 0; k < _sources.getSize(); k++)
+        _sources[k]->parser = std::thread(&TraceMerger::parse, this, _sources[k]);
+
+    for (int k = 0; k < _sources.getSize(); k++) {
+        if (!advance(_sources[k])) continue;
+        _heap.insertAtEnd(k);
+        siftUp(_heap.getSize() - 1);
+    }
+}
+
+
+
+// Parser thread: fills a chunk, waits for the handoff slot to be free and swaps it in
+void TraceMerger::parse(Source* source) {
+    ArrayList<Command> chunk(0);
+    chunk.assign(MERGE_CHUNK, Command());
+
+    while (true) {
+        int count = 0;
+        while (count < MERGE_CHUNK && source->reader.next(chunk[count])) count++;
+
+        std::unique_lock<std::mutex> lock(source->mutex);
+        source->changed.wait(lock, [&] { return source->stop || !source->ready; });
+        if (source->stop) return;
+        std::swap(source->handoff, chunk);
+        source->handoffSize = count;
+        source->ready = true;
+        source->changed.notify_all();
+        if (count < MERGE_CHUNK) return;
+    }
+}
+
+
+
+// Makes current[position] the next command of the source; false once it has none left
+bool TraceMerger::advance(Source* source) {
+    if (source->position < source->currentSize) return true;
+    if (source->last) return false;
+
+    std::unique_lock<std::mutex> lock(source->mutex);
+    source->changed.wait(lock, [&] { return source->ready; });
+    std::swap(source->current, source->handoff);
+    source->currentSize = source->handoffSize;
+    source->position = 0;
+    source->last = (source->currentSize < MERGE_CHUNK);
+    source->ready = false;
+    source->changed.notify_all();
+    return source->currentSize > 0;
+}
+
+
+
+
+bool TraceMerger::before(int a, int b) const {
+    const Source* first = _sources[a];
+    const Source* second = _sources[b];
+    int timeA = first->current[first->position].time;
+    int timeB = second->current[second->position].time;
+    return timeA < timeB || (timeA == timeB && a < b);
+}
+
+
+
+
+void TraceMerger::siftDown(int position) {
+    while (true) {
+        int smallest = position;
+        for (int child = 2 * position + 1; child <= 2 * position + 2 && child < _heap.getSize(); child++)
+            if (before(_heap[child], _heap[smallest])) smallest = child;
+        if (smallest == position) return;
+
+        std::swap(_heap[position], _heap[smallest]);
+        position = smallest;
+    }
+}
+
+
+
+
+void TraceMerger::siftUp(int position) {
+    while (position > 0 && before(_heap[position], _heap[(position - 1) / 2])) {
+        std::swap(_heap[position], _heap[(position - 1) / 2]);
+        position = (position - 1) / 2;
+    }
+}
+
+
+
+/* Hands out the earliest pending command of all the files. The source it came from
+*  stays on top of the heap if its next command is still the earliest, otherwise it
+*  sinks, or leaves the heap once its file is over.
+*/
+bool TraceMerger::next(Command& command) {
+    if (_sources.getSize() == 1) return _sources[0]->reader.next(command);
+    if (!_started) start();
+    if (_heap.isEmpty()) return false;
+
+    Source* source = _sources[_heap[0]];
+    command = std::move(source->current[source->position++]);
+
+    if (!advance(source)) {
+        _heap[0] = _heap[_heap.getSize() - 1];
+        _heap.removeFromPosition(_heap.getSize() - 1);
+    }
+    if (!_heap.isEmpty()) siftDown(0);
+    return true;
+}
+
+
+
+
+#endif
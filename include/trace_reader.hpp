@@ -0,0 +1,625 @@
+/**********************************************************************************
+ *
+ * FILE:            trace_reader.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Decodes the text trace of the logistics system into Command records.
+ *
+ * The input file is memory-mapped and tokenized in place, so it can be scanned more
+ * than once: the bulk-load mode walks it a first time only to count its lines,
+ * events and registrations (scan), sizes every structure of the ETS exactly once
+ * from them, and then rewinds the reader for the real ingestion pass.
+ *
+ * The tokenizer follows the rules of the former std::ifstream extraction: tokens are
+ * separated by any whitespace and the trace ends at the first time stamp that is not
+ * an integer.
+ *
+ * The same decoder also reads commands from memory (openBuffer), which is how the
+ * server mode parses the lines its clients send.
+ *
+ * Files that start with BINARY_TRACE_MAGIC are binary traces (see trace_writer.hpp)
+ * and are decoded without any tokenizing: their customer table is read once by
+ * open(), and next() then only decodes varints.
+ *
+ * With IoBackend::URING, a text trace is loaded by a ReadAhead (see uring_io.hpp)
+ * instead of mapped, and decoded one chunk at a time while the next one is being
+ * read: the tokenizer only sees a chunk up to its last whitespace, so no token is
+ * ever cut, and the reader moves on to the next chunk, carrying over what is left
+ * of this one, when little of it is left or when a command runs past it. Binary
+ * traces are always mapped, and so is every trace of the bulk-load mode, which
+ * reads them twice (see scan).
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef TRACE_READER_HPP
+#define TRACE_READER_HPP
+
+#include "array_list.hpp"
+#include "uring_io.hpp"
+
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+
+enum class CommandType { UNKNOWN, CL, PC, CW, PW, FZ, AG, WT, WP, SP, RG, AR, RM, UR, TR, EN, ST, TC, TP };
+
+
+
+// First bytes of a binary trace, followed by its version
+const char BINARY_TRACE_MAGIC[4] = { 'E', 'T', 'S', 'B' };
+const unsigned char BINARY_TRACE_VERSION = 1;
+
+
+
+// Every field a command of the trace may carry; unused fields keep their defaults
+struct Command {
+    int time = 0;
+    CommandType type = CommandType::UNKNOWN;
+    int packageId = 0;
+    int originWarehouseId = 0;
+    int destinationWarehouseId = 0;
+    int targetSection = 0;
+    int warehouseId = 0;
+    int windowBegin = 0;
+    int windowEnd = 0;
+    std::string sender;
+    std::string recipient;
+    std::string customerName;
+    // How many customers or packages TC and TP list
+    int limit = 0;
+
+    bool isEvent() const { return type >= CommandType::RG && type <= CommandType::ST; };
+    // Queries answered from the customer and package threads
+    bool isThreadQuery() const {
+        return type == CommandType::CL || type == CommandType::PC
+            || type == CommandType::CW || type == CommandType::PW;
+    };
+};
+
+
+
+/* Sizes gathered by the first pass of the bulk-load mode. They are upper bounds
+*  (packages: registrations; customers: two per registration plus the ST events),
+*  only used to size the structures.
+*/
+struct TraceStats {
+    int commands = 0;
+    int events = 0;
+    int packages = 0;
+    int customers = 0;
+};
+
+
+
+
+class TraceReader
+{
+    private:
+        const char* _begin;
+        const char* _end;
+        const char* _cursor;
+        // URING backend only: the end of the chunk, past the last whitespace _end stops at
+        const char* _loaded;
+        void* _mapping;
+        size_t _mappingSize;
+        std::string _buffer;
+        // Binary traces only: where the records start, the customer table and the last deltas
+        bool _binary;
+        const char* _records;
+        ArrayList<std::string> _customers;
+        int _lastTime;
+        int _lastPackageId;
+        // Set by the first command that could not be decoded, which ends the trace
+        bool _ended;
+        // URING backend only
+        ReadAhead _readAhead;
+
+        bool refill();
+        bool decode(Command& command);
+        bool nextText(Command& command);
+        bool readToken(const char*& token, size_t& length);
+        bool readInt(int& value);
+        bool readString(std::string& value);
+        bool openBinary();
+        bool readVarint(unsigned int& value);
+        bool readSigned(int& value);
+        bool readCustomer(std::string& value);
+        bool nextBinary(Command& command);
+
+    public:
+        TraceReader();
+        ~TraceReader();
+        TraceReader(const TraceReader& other) = delete;
+        TraceReader& operator=(const TraceReader& other) = delete;
+
+        // Opens a text or a binary trace, telling them apart by their first bytes
+        bool open(const char* path, IoBackend backend = IoBackend::SYNC);
+        bool isBinary() const { return _binary; };
+        // Reads the commands in [data, data + size), which must outlive the reader
+        void openBuffer(const char* data, size_t size);
+        bool next(Command& command);
+        // Neither of these works on a trace loaded by a ReadAhead, which keeps no more than a few chunks
+        void rewind();
+        // First pass of the bulk-load mode, which leaves the reader rewound
+        TraceStats scan();
+};
+
+
+
+
+TraceReader::TraceReader()
+    : _begin(nullptr), _end(nullptr), _cursor(nullptr), _loaded(nullptr), _mapping(nullptr), _mappingSize(0),
+      _binary(false), _records(nullptr), _customers(0), _lastTime(0), _lastPackageId(0), _ended(false) {}
+
+
+
+
+TraceReader::~TraceReader() {
+    if (_mapping != nullptr) munmap(_mapping, _mappingSize);
+}
+
+
+
+/* Maps the file, or starts loading it with io_uring if it is a text trace; anything
+*  that cannot be mapped (pipes, empty files) is read into memory.
+*/
+bool TraceReader::open(const char* path, IoBackend backend) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0;
+    char magic[sizeof(BINARY_TRACE_MAGIC)];
+    bool binary = regular && pread(fd, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic))
+                  && memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic)) == 0;
+    if (regular && !binary && backend == IoBackend::URING && _readAhead.open(fd, info.st_size)) {
+        _cursor = _loaded = nullptr;
+        return refill();
+    }
+    if (regular) {
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            _mapping = mapping;
+            _mappingSize = info.st_size;
+            _begin = static_cast<const char*>(mapping);
+            _end = _begin + _mappingSize;
+            _cursor = _begin;
+            close(fd);
+            return openBinary();
+        }
+    }
+
+    char chunk[1 << 16];
+    ssize_t bytes;
+    while ((bytes = read(fd, chunk, sizeof(chunk))) > 0)
+        _buffer.append(chunk, bytes);
+    close(fd);
+
+    _begin = _buffer.data();
+    _end = _begin + _buffer.size();
+    _cursor = _begin;
+    return bytes == 0 && openBinary();
+}
+
+
+
+// Reads the header of a binary trace, if it is one; text traces are left untouched
+bool TraceReader::openBinary() {
+    if (_end - _begin < 5 || memcmp(_begin, BINARY_TRACE_MAGIC, 4) != 0) return true;
+    if (static_cast<unsigned char>(_begin[4]) != BINARY_TRACE_VERSION) return false;
+    _cursor = _begin + 5;
+
+    unsigned int count, length;
+    if (!readVarint(count) || count > static_cast<size_t>(_end - _cursor)) return false;
+    _customers = ArrayList<std::string>(count);
+    for (unsigned int k = 0; k < count; k++) {
+        if (!readVarint(length) || length > static_cast<size_t>(_end - _cursor)) return false;
+        _customers.insertAtEnd(std::string(_cursor, length));
+        _cursor += length;
+    }
+
+    _binary = true;
+    _records = _cursor;
+    _lastTime = 0;
+    _lastPackageId = 0;
+    return true;
+}
+
+
+
+
+/* Moves on to the next chunk of the read-ahead, carrying over what is left of
+*  this one past the cursor, and lets the tokenizer see it up to its last
+*  whitespace, or whole at the end of the file. False once the file is all read.
+*/
+bool TraceReader::refill() {
+    const char* data;
+    size_t size;
+    if (!_readAhead.next(_cursor, _loaded - _cursor, data, size)) return false;
+
+    _begin = _cursor = data;
+    _end = _loaded = data + size;
+    if (_readAhead.isComplete()) return true;
+
+    while (_end > _cursor && !isspace(static_cast<unsigned char>(_end[-1]))) _end--;
+    return true;
+}
+
+
+
+
+void TraceReader::openBuffer(const char* data, size_t size) {
+    _binary = false;
+    _ended = false;
+    _begin = data;
+    _end = data + size;
+    _cursor = _begin;
+}
+
+
+
+
+void TraceReader::rewind() {
+    _ended = false;
+    if (!_binary) {
+        _cursor = _begin;
+        return;
+    }
+    _cursor = _records;
+    _lastTime = 0;
+    _lastPackageId = 0;
+}
+
+
+
+
+bool TraceReader::readToken(const char*& token, size_t& length) {
+    while (_cursor < _end && isspace(static_cast<unsigned char>(*_cursor))) _cursor++;
+    if (_cursor == _end) return false;
+
+    token = _cursor;
+    while (_cursor < _end && !isspace(static_cast<unsigned char>(*_cursor))) _cursor++;
+    length = _cursor - token;
+    return true;
+}
+
+
+
+
+bool TraceReader::readInt(int& value) {
+    while (_cursor < _end && isspace(static_cast<unsigned char>(*_cursor))) _cursor++;
+
+    bool negative = false;
+    if (_cursor < _end && (*_cursor == '-' || *_cursor == '+')) {
+        negative = (*_cursor == '-');
+        _cursor++;
+    }
+    if (_cursor == _end || *_cursor < '0' || *_cursor > '9') return false;
+
+    // A value that does not fit in an int makes the command malformed, rather than wrapping around
+    long limit = negative ? -static_cast<long>(INT_MIN) : INT_MAX;
+    long result = 0;
+    while (_cursor < _end && *_cursor >= '0' && *_cursor <= '9') {
+        result = result * 10 + (*_cursor - '0');
+        if (result > limit) return false;
+        _cursor++;
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+
+
+
+bool TraceReader::readString(std::string& value) {
+    const char* token;
+    size_t length;
+    if (!readToken(token, length)) return false;
+    value.assign(token, length);
+    return true;
+}
+
+
+
+/* Decodes the next command of the trace.
+*  Returns false at the end of the trace or at the first malformed command, and
+*  from then on, so the rest of a malformed line is never read as a command.
+*/
+bool TraceReader::next(Command& command) {
+    if (_ended) return false;
+    _ended = !decode(command);
+    return !_ended;
+}
+
+
+
+
+bool TraceReader::decode(Command& command) {
+    if (_binary) return nextBinary(command);
+    if (!_readAhead.active()) return nextText(command);
+
+    // Short commands are then never cut; the carry fits in front of the next chunk
+    if (static_cast<size_t>(_loaded - _cursor) < READ_AHEAD_CARRY / 2 && !_readAhead.isComplete()) refill();
+    const char* start = _cursor;
+    while (!nextText(command)) {
+        // Malformed before the end of the chunk, or at the end of the file
+        if (_cursor != _end || _readAhead.isComplete()) return false;
+
+        // Cut at the end of the chunk: decoded again with the next one behind it
+        _cursor = start;
+        if (!refill()) return false;
+        start = _cursor;
+    }
+    return true;
+}
+
+
+
+
+bool TraceReader::nextText(Command& command) {
+    const char* token;
+    size_t length;
+
+    if (!readInt(command.time)) return false;
+    if (!readToken(token, length)) return false;
+    command.type = CommandType::UNKNOWN;
+
+    if (length == 2 && memcmp(token, "CL", 2) == 0) {
+        command.type = CommandType::CL;
+        return readString(command.customerName);
+    }
+    if (length == 2 && memcmp(token, "PC", 2) == 0) {
+        command.type = CommandType::PC;
+        return readInt(command.packageId);
+    }
+    if (length == 2 && memcmp(token, "CW", 2) == 0) {
+        command.type = CommandType::CW;
+        return readString(command.customerName)
+            && readInt(command.windowBegin)
+            && readInt(command.windowEnd);
+    }
+    if (length == 2 && memcmp(token, "PW", 2) == 0) {
+        command.type = CommandType::PW;
+        return readInt(command.packageId)
+            && readInt(command.windowBegin)
+            && readInt(command.windowEnd);
+    }
+    if (length == 2 && memcmp(token, "FZ", 2) == 0) {
+        command.type = CommandType::FZ;
+        return true;
+    }
+    if (length == 2 && memcmp(token, "TC", 2) == 0) {
+        command.type = CommandType::TC;
+        return readInt(command.limit);
+    }
+    if (length == 2 && memcmp(token, "TP", 2) == 0) {
+        command.type = CommandType::TP;
+        return readInt(command.limit);
+    }
+    if (length == 2 && memcmp(token, "WP", 2) == 0) {
+        command.type = CommandType::WP;
+        return readInt(command.warehouseId);
+    }
+    if (length == 2 && memcmp(token, "SP", 2) == 0) {
+        command.type = CommandType::SP;
+        return readInt(command.warehouseId)
+            && readInt(command.targetSection);
+    }
+    if (length == 2 && memcmp(token, "AG", 2) == 0) {
+        command.type = CommandType::AG;
+        return readInt(command.windowBegin)
+            && readInt(command.windowEnd);
+    }
+    if (length == 2 && memcmp(token, "WT", 2) == 0) {
+        command.type = CommandType::WT;
+        return readInt(command.warehouseId)
+            && readInt(command.windowBegin)
+            && readInt(command.windowEnd);
+    }
+    if (length != 2 || memcmp(token, "EV", 2) != 0) return true;
+
+    if (!readToken(token, length)) return false;
+    if (length != 2) return true;
+
+    if (memcmp(token, "RG", 2) == 0) {
+        command.type = CommandType::RG;
+        return readInt(command.packageId)
+            && readString(command.sender)
+            && readString(command.recipient)
+            && readInt(command.originWarehouseId)
+            && readInt(command.destinationWarehouseId);
+    }
+    if (memcmp(token, "AR", 2) == 0) command.type = CommandType::AR;
+    else if (memcmp(token, "RM", 2) == 0) command.type = CommandType::RM;
+    else if (memcmp(token, "UR", 2) == 0) command.type = CommandType::UR;
+    if (command.type != CommandType::UNKNOWN) {
+        return readInt(command.packageId)
+            && readInt(command.destinationWarehouseId)
+            && readInt(command.targetSection);
+    }
+    if (memcmp(token, "TR", 2) == 0) {
+        command.type = CommandType::TR;
+        return readInt(command.packageId)
+            && readInt(command.originWarehouseId)
+            && readInt(command.destinationWarehouseId);
+    }
+    if (memcmp(token, "EN", 2) == 0) {
+        command.type = CommandType::EN;
+        return readInt(command.packageId)
+            && readInt(command.destinationWarehouseId);
+    }
+    if (memcmp(token, "ST", 2) == 0) {
+        command.type = CommandType::ST;
+        return readInt(command.packageId)
+            && readString(command.customerName);
+    }
+    return true;
+}
+
+
+
+bool TraceReader::readVarint(unsigned int& value) {
+    value = 0;
+    for (int shift = 0; _cursor < _end && shift < 35; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*_cursor++);
+        value |= static_cast<unsigned int>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+
+
+
+bool TraceReader::readSigned(int& value) {
+    unsigned int zigzag;
+    if (!readVarint(zigzag)) return false;
+    value = static_cast<int>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+    return true;
+}
+
+
+
+
+bool TraceReader::readCustomer(std::string& value) {
+    unsigned int id;
+    if (!readVarint(id) || id >= static_cast<unsigned int>(_customers.getSize())) return false;
+    value = _customers[id];
+    return true;
+}
+
+
+
+/* Decodes the next record of a binary trace, laid out as in trace_writer.hpp.
+*  Like the text decoder, stops at the end of the trace or at a truncated record.
+*/
+bool TraceReader::nextBinary(Command& command) {
+    if (_cursor >= _end) return false;
+    unsigned char type = static_cast<unsigned char>(*_cursor++);
+    if (type > static_cast<unsigned char>(CommandType::TP)) return false;
+    command.type = static_cast<CommandType>(type);
+
+    int delta;
+    if (!readSigned(delta)) return false;
+    command.time = _lastTime += delta;
+
+    if (command.type == CommandType::PC || command.type == CommandType::PW || command.isEvent()) {
+        if (!readSigned(delta)) return false;
+        command.packageId = _lastPackageId += delta;
+    }
+
+    switch (command.type) {
+        case CommandType::CL:
+            return readCustomer(command.customerName);
+        case CommandType::CW:
+            return readCustomer(command.customerName)
+                && readSigned(command.windowBegin) && readSigned(command.windowEnd);
+        case CommandType::PW:
+        case CommandType::AG:
+            return readSigned(command.windowBegin) && readSigned(command.windowEnd);
+        case CommandType::WT:
+            return readSigned(command.warehouseId)
+                && readSigned(command.windowBegin) && readSigned(command.windowEnd);
+        case CommandType::WP:
+            return readSigned(command.warehouseId);
+        case CommandType::SP:
+            return readSigned(command.warehouseId) && readSigned(command.targetSection);
+        case CommandType::RG:
+            return readCustomer(command.sender) && readCustomer(command.recipient)
+                && readSigned(command.originWarehouseId) && readSigned(command.destinationWarehouseId);
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            return readSigned(command.destinationWarehouseId) && readSigned(command.targetSection);
+        case CommandType::TR:
+            return readSigned(command.originWarehouseId) && readSigned(command.destinationWarehouseId);
+        case CommandType::EN:
+            return readSigned(command.destinationWarehouseId);
+        case CommandType::ST:
+            return readCustomer(command.customerName);
+        case CommandType::TC:
+        case CommandType::TP:
+            return readSigned(command.limit);
+        default:
+            return true;
+    }
+}
+
+
+
+/* First pass of the bulk-load mode: counts commands, events, registrations and ST
+*  events, which bound the packages and customers from above. A text trace is only
+*  walked line by line, looking at the first tokens of each, so nothing is decoded
+*  or hashed; a binary one is decoded, which needs no tokenizing, and its customer
+*  table already holds every name.
+*/
+TraceStats TraceReader::scan() {
+    TraceStats stats;
+
+    if (_binary) {
+        Command command;
+        while (nextBinary(command)) {
+            stats.commands++;
+            if (command.isEvent()) stats.events++;
+            if (command.type == CommandType::RG) stats.packages++;
+        }
+        stats.customers = _customers.getSize();
+        rewind();
+        return stats;
+    }
+
+    int stakeholders = 0;
+    for (const char* line = _begin; line < _end; ) {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', _end - line));
+        if (lineEnd == nullptr) lineEnd = _end;
+
+        // Skips the time stamp; lines without a second token are blank
+        const char* token = line;
+        while (token < lineEnd && isspace(static_cast<unsigned char>(*token))) token++;
+        while (token < lineEnd && !isspace(static_cast<unsigned char>(*token))) token++;
+        while (token < lineEnd && isspace(static_cast<unsigned char>(*token))) token++;
+        line = lineEnd + 1;
+        if (token == lineEnd) continue;
+
+        stats.commands++;
+        if (lineEnd - token < 5 || memcmp(token, "EV", 2) != 0 || !isspace(static_cast<unsigned char>(token[2]))) continue;
+        stats.events++;
+        for (token += 3; token < lineEnd && isspace(static_cast<unsigned char>(*token)); token++);
+        if (lineEnd - token < 2) continue;
+        if (memcmp(token, "RG", 2) == 0) stats.packages++;
+        else if (memcmp(token, "ST", 2) == 0) stakeholders++;
+    }
+    stats.customers = 2 * stats.packages + stakeholders;
+    rewind();
+    return stats;
+}
+
+
+
+
+#endif
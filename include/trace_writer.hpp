@@ -0,0 +1,209 @@
+/**********************************************************************************
+ *
+ * FILE:            trace_writer.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Encodes commands into a binary trace, which TraceReader reads back without any
+ * text parsing and which takes a fraction of the space of the text trace.
+ *
+ * Layout of the file:
+ *
+ *   "ETSB" [version] [customer count] ([name length] [name bytes])...
+ *   [type] [time - previous time] [package id - previous package id] [fields]...
+ *
+ * Every integer is a zigzag varint, as in event_log.hpp (lengths and counts are
+ * plain varints). The package id delta is only present for PC, PW and the events,
+ * and customer names are written as ids into the table of the header. The fields
+ * follow the order of the text trace:
+ *
+ *   CL customer            CW customer begin end    PW begin end
+ *   AG begin end           WT warehouse begin end   WP warehouse
+ *   SP warehouse section   RG sender recipient origin destination
+ *   AR/RM/UR destination section   TR origin destination   EN destination
+ *   ST stakeholder         TC/TP limit
+ *
+ * The header is only known once every command has been seen, so the records are
+ * kept in memory and the whole file is written by save().
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef TRACE_WRITER_HPP
+#define TRACE_WRITER_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+#include "trace_reader.hpp"
+
+#include <string>
+#include <fstream>
+
+
+
+
+class TraceWriter
+{
+    private:
+        Hash<std::string, int> _customerIds;
+        ArrayList<std::string> _customerNames;
+        std::string _records;
+        int _lastTime;
+        int _lastPackageId;
+
+        static void putVarint(std::string& out, unsigned int value);
+        void putSigned(int value);
+        void putCustomer(const std::string& name);
+
+    public:
+        TraceWriter();
+
+        void append(const Command& command);
+        // Writes the header and the records; false if the file could not be written
+        bool save(const char* path) const;
+        size_t getRecordBytes() const { return _records.size(); };
+};
+
+
+
+
+TraceWriter::TraceWriter() : _customerIds(1000), _customerNames(1000), _lastTime(0), _lastPackageId(0) {}
+
+
+
+
+void TraceWriter::putVarint(std::string& out, unsigned int value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+
+
+
+void TraceWriter::putSigned(int value) {
+    putVarint(_records, (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31));
+}
+
+
+
+
+void TraceWriter::putCustomer(const std::string& name) {
+    const int* id = _customerIds.find(name);
+    if (id == nullptr) {
+        _customerIds.insert(name, _customerNames.getSize());
+        _customerNames.insertAtEnd(name);
+        id = _customerIds.find(name);
+    }
+    putVarint(_records, *id);
+}
+
+
+
+
+void TraceWriter::append(const Command& command) {
+    _records += static_cast<char>(command.type);
+    putSigned(command.time - _lastTime);
+    _lastTime = command.time;
+
+    if (command.type == CommandType::PC || command.type == CommandType::PW || command.isEvent()) {
+        putSigned(command.packageId - _lastPackageId);
+        _lastPackageId = command.packageId;
+    }
+
+    switch (command.type) {
+        case CommandType::CL:
+            putCustomer(command.customerName);
+            break;
+        case CommandType::CW:
+            putCustomer(command.customerName);
+            putSigned(command.windowBegin);
+            putSigned(command.windowEnd);
+            break;
+        case CommandType::PW:
+        case CommandType::AG:
+            putSigned(command.windowBegin);
+            putSigned(command.windowEnd);
+            break;
+        case CommandType::WT:
+            putSigned(command.warehouseId);
+            putSigned(command.windowBegin);
+            putSigned(command.windowEnd);
+            break;
+        case CommandType::WP:
+            putSigned(command.warehouseId);
+            break;
+        case CommandType::SP:
+            putSigned(command.warehouseId);
+            putSigned(command.targetSection);
+            break;
+        case CommandType::RG:
+            putCustomer(command.sender);
+            putCustomer(command.recipient);
+            putSigned(command.originWarehouseId);
+            putSigned(command.destinationWarehouseId);
+            break;
+        case CommandType::AR:
+        case CommandType::RM:
+        case CommandType::UR:
+            putSigned(command.destinationWarehouseId);
+            putSigned(command.targetSection);
+            break;
+        case CommandType::TR:
+            putSigned(command.originWarehouseId);
+            putSigned(command.destinationWarehouseId);
+            break;
+        case CommandType::EN:
+            putSigned(command.destinationWarehouseId);
+            break;
+        case CommandType::ST:
+            putCustomer(command.customerName);
+            break;
+        case CommandType::TC:
+        case CommandType::TP:
+            putSigned(command.limit);
+            break;
+        default:
+            break;
+    }
+}
+
+
+
+
+bool TraceWriter::save(const char* path) const {
+    std::string header(BINARY_TRACE_MAGIC, 4);
+    header += static_cast<char>(BINARY_TRACE_VERSION);
+    putVarint(header, _customerNames.getSize());
+    for (int id = 0; id < _customerNames.getSize(); id++) {
+        putVarint(header, _customerNames[id].size());
+        header += _customerNames[id];
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(header.data(), header.size());
+    file.write(_records.data(), _records.size());
+    file.close();
+    return !file.fail();
+}
+
+
+
+
+#endif
@@ -0,0 +1,401 @@
+/**********************************************************************************
+ *
+ * FILE:            unix_server.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Single-threaded Unix domain socket server driven by epoll, which lets local
+ * clients send commands to a running process instead of replaying a whole trace.
+ *
+ * The protocol is the trace itself: each client writes command lines, and each
+ * complete line is handed to the line handler, which appends the answer (if any)
+ * to the output buffer of that client. Clients may pipeline as many lines as they
+ * want; they are handled in order and the answers come back in the same order.
+ *
+ * Every connection has its own input and output buffers. Answers are rendered by
+ * the handler straight into the output buffer, which is written to the socket
+ * from there as the client reads it; while more than OUTPUT_HIGH_WATER bytes wait
+ * to be read, the server stops reading from that client.
+ *
+ * The handler may also leave an answer for later (defer) and hand it over from any
+ * thread once it is ready (post); an eventfd wakes the loop, which writes posted
+ * answers in the order they were posted. A connection with deferred answers is
+ * kept open until all of them have been written, and the handler is expected to
+ * defer every following line of that client as well, so its answers stay in order.
+ *
+ * The loop runs until SIGINT or SIGTERM, received through a signalfd so that they
+ * only stop the loop between two events, and then removes the socket file.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef UNIX_SERVER_HPP
+#define UNIX_SERVER_HPP
+
+#include "array_list.hpp"
+#include "hash.hpp"
+
+#include <string>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+
+
+const size_t OUTPUT_HIGH_WATER = 1 << 20;
+const size_t INPUT_LINE_LIMIT = 1 << 20;
+const int READ_CHUNK = 1 << 16;
+
+
+
+
+class UnixServer
+{
+    public:
+        // Identifies a connection from any thread: descriptors are reused, serials are not
+        struct Client {
+            int fd = -1;
+            unsigned long serial = 0;
+        };
+
+        // Handles one command line (without its line break), appending the answer to out
+        using LineHandler = std::function<void(const Client& client, const char* line, size_t length, std::string& out)>;
+
+    private:
+        struct Connection {
+            std::string input;
+            std::string output;
+            size_t sent = 0;
+            bool closing = false;
+            unsigned int events = 0;
+            unsigned long serial = 0;
+            // Deferred answers not posted yet
+            int pending = 0;
+        };
+
+        struct Answer {
+            Client client;
+            std::string text;
+        };
+
+        int _listenFd;
+        int _epollFd;
+        int _signalFd;
+        int _wakeFd;
+        std::string _path;
+        Hash<int, Connection> _connections;
+        unsigned long _nextSerial;
+        std::mutex _postMutex;
+        ArrayList<Answer> _posted;
+
+        void acceptClients();
+        void deliver();
+        bool receive(int fd, Connection& connection, const LineHandler& handler);
+        bool send(int fd, Connection& connection);
+        bool watch(int fd, Connection& connection);
+        void disconnect(int fd);
+
+    public:
+        UnixServer();
+        ~UnixServer();
+        UnixServer(const UnixServer& other) = delete;
+        UnixServer& operator=(const UnixServer& other) = delete;
+
+        // Binds the socket at path, replacing a stale socket file left there
+        bool open(const char* path);
+        // Serves the clients until SIGINT or SIGTERM; false if epoll itself fails
+        bool run(const LineHandler& handler);
+
+        // Loop thread only: promises an answer for the current line of the client
+        void defer(const Client& client);
+        bool hasPending(const Client& client) const;
+        // Any thread: the next deferred answer of the client; dropped if it is gone
+        void post(const Client& client, const std::string& text);
+};
+
+
+
+
+UnixServer::UnixServer()
+    : _listenFd(-1), _epollFd(-1), _signalFd(-1), _wakeFd(-1), _connections(64), _nextSerial(1), _posted(64) {}
+
+
+
+
+UnixServer::~UnixServer() {
+    _connections.forEach([](const int& fd, const Connection&) { close(fd); });
+    if (_wakeFd >= 0) close(_wakeFd);
+    if (_signalFd >= 0) close(_signalFd);
+    if (_epollFd >= 0) close(_epollFd);
+    if (_listenFd >= 0) {
+        close(_listenFd);
+        unlink(_path.c_str());
+    }
+}
+
+
+
+
+bool UnixServer::open(const char* path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return false;
+    unlink(path);
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        close(listenFd);
+        return false;
+    }
+    _listenFd = listenFd;
+    _path = path;
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    _signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_signalFd < 0 || _wakeFd < 0 || _epollFd < 0) return false;
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = _listenFd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event) != 0) return false;
+    event.data.fd = _wakeFd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &event) != 0) return false;
+    event.data.fd = _signalFd;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, _signalFd, &event) == 0;
+}
+
+
+
+
+bool UnixServer::run(const LineHandler& handler) {
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int ready = epoll_wait(_epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        for (int k = 0; k < ready; k++) {
+            int fd = events[k].data.fd;
+            if (fd == _signalFd) return true;
+            if (fd == _listenFd) {
+                acceptClients();
+                continue;
+            }
+            if (fd == _wakeFd) {
+                deliver();
+                continue;
+            }
+            if (!_connections.contains(fd)) continue;
+
+            Connection& connection = _connections[fd];
+            bool alive = true;
+            if (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                alive = receive(fd, connection, handler);
+            if (alive) alive = send(fd, connection);
+            if (alive) alive = !(connection.closing && connection.output.empty() && connection.pending == 0) && watch(fd, connection);
+            if (!alive) disconnect(fd);
+        }
+    }
+}
+
+
+
+
+void UnixServer::acceptClients() {
+    while (true) {
+        int fd = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        Connection& connection = _connections[fd];
+        connection = Connection();
+        connection.serial = _nextSerial++;
+        if (!watch(fd, connection)) disconnect(fd);
+    }
+}
+
+
+
+// Appends the posted answers to their connections, in order, and writes them out
+void UnixServer::deliver() {
+    uint64_t wakeups;
+    if (read(_wakeFd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN) return;
+
+    ArrayList<Answer> answers(0);
+    {
+        std::lock_guard<std::mutex> lock(_postMutex);
+        std::swap(answers, _posted);
+    }
+
+    for (int k = 0; k < answers.getSize(); k++) {
+        const Client& client = answers[k].client;
+        if (!_connections.contains(client.fd) || _connections[client.fd].serial != client.serial) continue;
+        Connection& connection = _connections[client.fd];
+        connection.output += answers[k].text;
+        connection.pending--;
+    }
+
+    for (int k = 0; k < answers.getSize(); k++) {
+        int fd = answers[k].client.fd;
+        if (!_connections.contains(fd) || _connections[fd].serial != answers[k].client.serial) continue;
+        Connection& connection = _connections[fd];
+        bool alive = send(fd, connection);
+        if (alive) alive = !(connection.closing && connection.output.empty() && connection.pending == 0) && watch(fd, connection);
+        if (!alive) disconnect(fd);
+    }
+}
+
+
+
+
+void UnixServer::defer(const Client& client) {
+    _connections[client.fd].pending++;
+}
+
+
+
+
+bool UnixServer::hasPending(const Client& client) const {
+    const Connection* connection = _connections.find(client.fd);
+    return connection != nullptr && connection->pending > 0;
+}
+
+
+
+
+void UnixServer::post(const Client& client, const std::string& text) {
+    std::lock_guard<std::mutex> lock(_postMutex);
+    Answer answer;
+    answer.client = client;
+    answer.text = text;
+    _posted.insertAtEnd(answer);
+
+    // Only the first answer of a batch needs to wake the loop
+    if (_posted.getSize() == 1) {
+        uint64_t one = 1;
+        if (write(_wakeFd, &one, sizeof(one)) < 0) return;
+    }
+}
+
+
+
+/* Reads what the client sent and handles every complete line of it. At the end
+*  of its input the client is only kept until its pending answers are written.
+*/
+bool UnixServer::receive(int fd, Connection& connection, const LineHandler& handler) {
+    char chunk[READ_CHUNK];
+
+    while (!connection.closing && connection.output.size() - connection.sent < OUTPUT_HIGH_WATER) {
+        ssize_t bytes = read(fd, chunk, sizeof(chunk));
+        if (bytes < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        if (bytes == 0) {
+            connection.closing = true;
+            // A last line without its line break still counts
+            if (!connection.input.empty()) connection.input += '\n';
+        } else {
+            connection.input.append(chunk, bytes);
+        }
+
+        Client client;
+        client.fd = fd;
+        client.serial = connection.serial;
+        size_t begin = 0;
+        for (size_t end = connection.input.find('\n'); end != std::string::npos; end = connection.input.find('\n', begin)) {
+            handler(client, connection.input.data() + begin, end - begin, connection.output);
+            begin = end + 1;
+        }
+        connection.input.erase(0, begin);
+        if (connection.input.size() > INPUT_LINE_LIMIT) return false;
+    }
+    return true;
+}
+
+
+
+
+bool UnixServer::send(int fd, Connection& connection) {
+    while (connection.sent < connection.output.size()) {
+        ssize_t bytes = ::send(fd, connection.output.data() + connection.sent,
+                               connection.output.size() - connection.sent, MSG_NOSIGNAL);
+        if (bytes < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            return false;
+        }
+        connection.sent += bytes;
+    }
+
+    connection.output.clear();
+    connection.sent = 0;
+    return true;
+}
+
+
+
+// Waits for input unless the client is closing or too far behind, and for room to write if answers are pending
+bool UnixServer::watch(int fd, Connection& connection) {
+    unsigned int wanted = 0;
+    if (!connection.closing && connection.output.size() - connection.sent < OUTPUT_HIGH_WATER) wanted |= EPOLLIN;
+    if (connection.sent < connection.output.size()) wanted |= EPOLLOUT;
+    if (wanted == connection.events) return true;
+
+    epoll_event event;
+    event.events = wanted;
+    event.data.fd = fd;
+    int operation = (connection.events == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (wanted == 0) operation = EPOLL_CTL_DEL;
+    if (epoll_ctl(_epollFd, operation, fd, &event) != 0) return false;
+
+    connection.events = wanted;
+    return true;
+}
+
+
+
+
+void UnixServer::disconnect(int fd) {
+    _connections.erase(fd);
+    close(fd);
+}
+
+
+
+
+#endif
@@ -0,0 +1,561 @@
+/**********************************************************************************
+ *
+ * FILE:            uring_io.hpp
+ *
+ * ********************************************************************************
+ *
+ * PROJECT:         Project Name (Entangled Threads Structure Algorithm)
+ *
+ * ********************************************************************************
+ *
+ * DESCRIPTION:
+ * Asynchronous input and output through Linux io_uring (--io uring), so that the
+ * thread applying the trace does not stop on the page cache or on the pipe.
+ *
+ * IoRing is a minimal ring driven by the raw system calls (io_uring_setup and
+ * io_uring_enter), with no library: reads and writes are queued in the submission
+ * ring and their results taken from the completion ring.
+ *
+ * ReadAhead loads a trace file in chunks of READ_AHEAD_CHUNK into READ_AHEAD_DEPTH
+ * buffers that it reuses in turn: while the reader decodes the chunk of one, the
+ * kernel fills the others. The reader hands back the end of a chunk it could not
+ * decode yet (a command cut by the chunk boundary), which is copied in front of
+ * the next chunk, in room kept there for it, so every command is still tokenized
+ * in place. Only a command longer than that room costs a buffer of its own. The
+ * memory used is then a few chunks, whatever the size of the file; as nothing is
+ * kept, the reader cannot rewind it, and the bulk-load mode maps its files.
+ *
+ * OutputWriter hands each output buffer to the kernel and returns at once with
+ * the buffer of the previous write, once that one is done: one buffer fills while
+ * the other is written.
+ *
+ * When a ring cannot be created (kernels without io_uring, or with it disabled,
+ * seccomp filters) everything falls back to the blocking path: the mapped file
+ * and std::cout.
+ *
+ * ********************************************************************************
+ *
+ * COPYRIGHT NOTICE:
+ * Copyright (c) 2025 Cristiano Rezende Sá Miranda Gonçalves
+ *
+ * This software is released under the MIT License.
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/license/mit>.
+ *
+ * SPDX-License-Identifier: MIT
+ **********************************************************************************/
+
+#ifndef URING_IO_HPP
+#define URING_IO_HPP
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <utility>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+
+
+enum class IoBackend { SYNC, URING };
+
+
+
+// Bytes of each read of the trace, and how many buffers take them in turn
+const unsigned READ_AHEAD_CHUNK = 1 << 20;
+const int READ_AHEAD_DEPTH = 2;
+// Room in front of each chunk for the end of the one before it
+const size_t READ_AHEAD_CARRY = 1 << 12;
+
+// Largest single write handed to the ring; longer buffers go in several
+const size_t URING_WRITE_LIMIT = 1 << 30;
+
+
+
+
+class IoRing
+{
+    private:
+        int _fd;
+        void* _sqRing;
+        size_t _sqRingSize;
+        void* _cqRing;
+        size_t _cqRingSize;
+        io_uring_sqe* _sqes;
+        size_t _sqesSize;
+        unsigned* _sqHead;
+        unsigned* _sqTail;
+        unsigned* _sqMask;
+        unsigned* _sqArray;
+        unsigned _sqEntries;
+        unsigned* _cqHead;
+        unsigned* _cqTail;
+        unsigned* _cqMask;
+        io_uring_cqe* _cqes;
+        // Entries queued and not submitted yet
+        unsigned _queued;
+
+        void close();
+
+    public:
+        IoRing();
+        ~IoRing() { close(); };
+        IoRing(const IoRing& other) = delete;
+        IoRing& operator=(const IoRing& other) = delete;
+
+        // False, with errno set, if the kernel does not provide the ring
+        bool open(unsigned entries);
+        bool enabled() const { return _fd >= 0; };
+
+        // Queues a read or a write (IORING_OP_READ/WRITE) tagged with data; offset -1 is the file position
+        bool queue(int opcode, int fd, void* buffer, unsigned length, int64_t offset, uint64_t data);
+        // Submits what is queued and, with wait, blocks until a completion is available
+        bool submit(bool wait);
+        // Takes the next completion, if there is one
+        bool reap(uint64_t& data, int& result);
+        // Takes the next completion, waiting for it
+        bool wait(uint64_t& data, int& result);
+};
+
+
+
+
+class ReadAhead
+{
+    private:
+        IoRing _ring;
+        int _fd;
+        size_t _size;
+        // Where the next chunk to queue starts
+        size_t _next;
+        // A chunk of the file, read after READ_AHEAD_CARRY bytes of its buffer; done counts short reads
+        struct Chunk {
+            std::string buffer;
+            size_t begin = 0;
+            size_t end = 0;
+            size_t done = 0;
+            bool busy = false;
+        };
+        Chunk _chunks[READ_AHEAD_DEPTH];
+        // Slot handed to the reader last, -1 before the first chunk
+        int _current;
+        // The carry followed by the chunk, when the carry does not fit in front of it
+        std::string _joined;
+        bool _failed;
+
+        void assign(int slot);
+        void queueChunk(int slot);
+        void complete(uint64_t slot, int result);
+        bool inFlight() const;
+        void waitChunk(int slot);
+
+    public:
+        ReadAhead();
+        ~ReadAhead();
+        ReadAhead(const ReadAhead& other) = delete;
+        ReadAhead& operator=(const ReadAhead& other) = delete;
+
+        // Starts loading the size bytes of fd, which it then owns; false if no ring could be created
+        bool open(int fd, size_t size);
+        bool active() const { return _fd >= 0; };
+        // Whether the chunk handed out last is the end of the file
+        bool isComplete() const;
+        /* Waits for the next chunk and hands it out behind a copy of the carrySize
+        *  bytes at carry, the part of the previous one the reader still needs.
+        *  data stays valid until the next call; false once the file is all handed out.
+        */
+        bool next(const char* carry, size_t carrySize, const char*& data, size_t& size);
+};
+
+
+
+
+class OutputWriter
+{
+    private:
+        IoRing _ring;
+        int _fd;
+        // Buffer the kernel is writing, and how much of it is written
+        std::string _inFlight;
+        size_t _written;
+        bool _busy;
+
+        void queueRest();
+
+    public:
+        explicit OutputWriter(IoBackend backend, int fd = STDOUT_FILENO);
+        ~OutputWriter() { finish(); };
+        OutputWriter(const OutputWriter& other) = delete;
+        OutputWriter& operator=(const OutputWriter& other) = delete;
+
+        // Writes output out and clears it; with the ring it only waits for the previous write
+        void write(std::string& output);
+        // Waits for the write in flight
+        void finish();
+};
+
+
+
+
+IoRing::IoRing()
+    : _fd(-1), _sqRing(MAP_FAILED), _sqRingSize(0), _cqRing(MAP_FAILED), _cqRingSize(0), _sqes(nullptr), _sqesSize(0),
+      _sqHead(nullptr), _sqTail(nullptr), _sqMask(nullptr), _sqArray(nullptr), _sqEntries(0),
+      _cqHead(nullptr), _cqTail(nullptr), _cqMask(nullptr), _cqes(nullptr), _queued(0) {}
+
+
+
+
+void IoRing::close() {
+    if (_sqes != nullptr) munmap(_sqes, _sqesSize);
+    if (_cqRing != MAP_FAILED && _cqRing != _sqRing) munmap(_cqRing, _cqRingSize);
+    if (_sqRing != MAP_FAILED) munmap(_sqRing, _sqRingSize);
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+    _sqes = nullptr;
+    _sqRing = _cqRing = MAP_FAILED;
+}
+
+
+
+/* Maps the two rings and the submission entries. The file position of offset -1
+*  (IORING_FEAT_RW_CUR_POS, Linux 5.6) is required, as the writes to stdout use it.
+*/
+bool IoRing::open(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0) return false;
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close();
+        errno = ENOSYS;
+        return false;
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) _sqRingSize = _cqRingSize = (_sqRingSize > _cqRingSize) ? _sqRingSize : _cqRingSize;
+
+    _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        close();
+        return false;
+    }
+    _cqRing = single ? _sqRing : mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (_cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        close();
+        return false;
+    }
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    _sqEntries = params.sq_entries;
+
+    char* cq = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+
+
+
+bool IoRing::queue(int opcode, int fd, void* buffer, unsigned length, int64_t offset, uint64_t data) {
+    unsigned tail = *_sqTail;
+    if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) return false;
+
+    unsigned index = tail & *_sqMask;
+    io_uring_sqe& entry = _sqes[index];
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = opcode;
+    entry.fd = fd;
+    entry.addr = reinterpret_cast<uint64_t>(buffer);
+    entry.len = length;
+    entry.off = static_cast<uint64_t>(offset);
+    entry.user_data = data;
+    _sqArray[index] = index;
+
+    // The kernel must see the entry before the new tail
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    _queued++;
+    return true;
+}
+
+
+
+
+bool IoRing::submit(bool wait) {
+    while (true) {
+        int submitted = syscall(__NR_io_uring_enter, _fd, _queued, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted >= 0) {
+            _queued -= submitted;
+            return true;
+        }
+        if (errno != EINTR) return false;
+    }
+}
+
+
+
+
+bool IoRing::reap(uint64_t& data, int& result) {
+    unsigned head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) return false;
+
+    const io_uring_cqe& completion = _cqes[head & *_cqMask];
+    data = completion.user_data;
+    result = completion.res;
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+
+
+bool IoRing::wait(uint64_t& data, int& result) {
+    while (!reap(data, result))
+        if (!submit(true)) return false;
+    return true;
+}
+
+
+
+
+ReadAhead::ReadAhead() : _fd(-1), _size(0), _next(0), _current(-1), _failed(false) {}
+
+
+
+// The chunks in flight are written into the buffers: they must land before these go away
+ReadAhead::~ReadAhead() {
+    uint64_t slot;
+    int result;
+    while (inFlight() && _ring.wait(slot, result)) _chunks[slot].busy = false;
+    if (_fd >= 0) close(_fd);
+}
+
+
+
+
+bool ReadAhead::open(int fd, size_t size) {
+    if (!_ring.open(2 * READ_AHEAD_DEPTH)) return false;
+
+    _fd = fd;
+    _size = size;
+    size_t chunk = (size < READ_AHEAD_CHUNK) ? size : READ_AHEAD_CHUNK;
+    for (int slot = 0; slot < READ_AHEAD_DEPTH; slot++) {
+        _chunks[slot].buffer.resize(READ_AHEAD_CARRY + chunk);
+        assign(slot);
+    }
+    if (!_ring.submit(false)) _failed = true;
+    return true;
+}
+
+
+
+// Gives the slot the next chunk of the file, if any is left
+void ReadAhead::assign(int slot) {
+    Chunk& chunk = _chunks[slot];
+    chunk.begin = chunk.end = chunk.done = 0;
+    if (_next >= _size) return;
+
+    chunk.begin = _next;
+    chunk.end = (_size - _next > READ_AHEAD_CHUNK) ? _next + READ_AHEAD_CHUNK : _size;
+    _next = chunk.end;
+    queueChunk(slot);
+}
+
+
+
+
+void ReadAhead::queueChunk(int slot) {
+    if (_failed) return;
+    Chunk& chunk = _chunks[slot];
+    char* target = &chunk.buffer[READ_AHEAD_CARRY + chunk.done];
+    if (!_ring.queue(IORING_OP_READ, _fd, target, chunk.end - chunk.begin - chunk.done, chunk.begin + chunk.done, slot)) _failed = true;
+    else chunk.busy = true;
+}
+
+
+
+// Short reads are queued again for the rest of their chunk
+void ReadAhead::complete(uint64_t slot, int result) {
+    Chunk& chunk = _chunks[slot];
+    chunk.busy = false;
+    if (result == -EINTR || result == -EAGAIN) {
+        queueChunk(slot);
+        return;
+    }
+    // An error, or a file that got shorter: the rest is read the blocking way
+    if (result <= 0) {
+        _failed = true;
+        return;
+    }
+
+    chunk.done += result;
+    if (chunk.begin + chunk.done < chunk.end) queueChunk(slot);
+}
+
+
+
+
+bool ReadAhead::inFlight() const {
+    for (int slot = 0; slot < READ_AHEAD_DEPTH; slot++)
+        if (_chunks[slot].busy) return true;
+    return false;
+}
+
+
+
+// Waits until the chunk of the slot is loaded, reading with pread what the ring did not
+void ReadAhead::waitChunk(int slot) {
+    Chunk& chunk = _chunks[slot];
+    uint64_t tag;
+    int result;
+    while (chunk.busy) {
+        if (_ring.wait(tag, result)) {
+            complete(tag, result);
+            continue;
+        }
+        // The ring is gone: nothing queued can land any more
+        _failed = true;
+        for (int k = 0; k < READ_AHEAD_DEPTH; k++) _chunks[k].busy = false;
+    }
+
+    while (chunk.begin + chunk.done < chunk.end) {
+        ssize_t bytes = pread(_fd, &chunk.buffer[READ_AHEAD_CARRY + chunk.done],
+                              chunk.end - chunk.begin - chunk.done, chunk.begin + chunk.done);
+        if (bytes <= 0) {
+            // The file ends here
+            chunk.end = chunk.begin + chunk.done;
+            _size = _next = chunk.end;
+            break;
+        }
+        chunk.done += bytes;
+    }
+}
+
+
+
+
+bool ReadAhead::isComplete() const {
+    const Chunk& following = _chunks[(_current + 1) % READ_AHEAD_DEPTH];
+    return _current >= 0 && following.begin == following.end;
+}
+
+
+
+
+bool ReadAhead::next(const char* carry, size_t carrySize, const char*& data, size_t& size) {
+    int slot = (_current + 1) % READ_AHEAD_DEPTH;
+    Chunk& chunk = _chunks[slot];
+    if (chunk.begin == chunk.end) return false;
+    waitChunk(slot);
+
+    size_t loaded = chunk.end - chunk.begin;
+    if (carrySize <= READ_AHEAD_CARRY) {
+        char* start = &chunk.buffer[READ_AHEAD_CARRY - carrySize];
+        if (carrySize > 0) memcpy(start, carry, carrySize);
+        data = start;
+    } else {
+        // The carry may be in _joined itself
+        std::string joined;
+        joined.reserve(carrySize + loaded);
+        joined.assign(carry, carrySize);
+        joined.append(&chunk.buffer[READ_AHEAD_CARRY], loaded);
+        _joined.swap(joined);
+        data = _joined.data();
+    }
+    size = carrySize + loaded;
+
+    // The buffer the reader leaves takes the chunk after the ones in flight
+    if (_current >= 0) {
+        assign(_current);
+        if (!_failed && !_ring.submit(false)) _failed = true;
+    }
+    _current = slot;
+    return true;
+}
+
+
+
+
+OutputWriter::OutputWriter(IoBackend backend, int fd) : _fd(fd), _written(0), _busy(false) {
+    if (backend == IoBackend::URING) _ring.open(2);
+}
+
+
+
+
+void OutputWriter::queueRest() {
+    size_t length = _inFlight.size() - _written;
+    if (length > URING_WRITE_LIMIT) length = URING_WRITE_LIMIT;
+    _busy = _ring.queue(IORING_OP_WRITE, _fd, &_inFlight[_written], length, -1, 0);
+    if (_busy) _ring.submit(false);
+}
+
+
+
+
+void OutputWriter::write(std::string& output) {
+    if (!_ring.enabled()) {
+        std::cout.write(output.data(), output.size());
+        std::cout.flush();
+        output.clear();
+        return;
+    }
+
+    finish();
+    std::swap(_inFlight, output);
+    output.clear();
+    _written = 0;
+    if (!_inFlight.empty()) queueRest();
+}
+
+
+
+/* Short writes are queued again for the rest of the buffer. A descriptor in
+*  non-blocking mode is polled until it takes more; any other error drops the
+*  buffer, as a failed std::cout would.
+*/
+void OutputWriter::finish() {
+    while (_busy) {
+        uint64_t data;
+        int result;
+        if (!_ring.wait(data, result)) {
+            _busy = false;
+            return;
+        }
+
+        if (result == -EAGAIN) {
+            pollfd ready = { _fd, POLLOUT, 0 };
+            poll(&ready, 1, -1);
+        } else if (result < 0 && result != -EINTR) {
+            _busy = false;
+            return;
+        } else if (result > 0) {
+            _written += result;
+        }
+
+        if (_written == _inFlight.size()) _busy = false;
+        else queueRest();
+    }
+}
+
+
+
+
+#endif
@@ -2,6 +2,10 @@
 #define UTILS_HPP
 
 
+#include <cstddef>
+#include <string>
+
+
 
 
 // Atribuição por movimentação.
@@ -12,4 +16,33 @@ T&& my_move(T& obj) noexcept {
 
 
 
+// Contabilidade de memória das estruturas: bytes alocados no heap e, destes, quantos
+// guardam dados válidos (a diferença é a folga, ou fragmentação, da estrutura)
+struct MemoryUsage {
+    size_t bytes = 0;
+    size_t usedBytes = 0;
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        bytes += other.bytes;
+        usedBytes += other.usedBytes;
+        return *this;
+    }
+};
+
+
+
+// Bytes que um elemento aloca fora de si mesmo (nenhum, por padrão)
+template<typename T>
+size_t heapBytes(const T&) {
+    return 0;
+}
+
+// Strings curtas ficam dentro do próprio objeto; só as maiores usam o heap
+inline size_t heapBytes(const std::string& text) {
+    static const size_t localCapacity = std::string().capacity();
+    return (text.capacity() > localCapacity) ? text.capacity() + 1 : 0;
+}
+
+
+
 #endif
\ No newline at end of file
@@ -80,18 +80,81 @@
  * entangled threads, reflecting the complex interconnections among its components.
  *  
  * The current file (main.cpp) contains not only the input and output code, but 
- * also the full implementation of the node movement logic within the list update
- * functions.
+ * also the node movement logic of the events; the list update functions it relies
+ * on are in thread_update.hpp, shared with the benchmark.
  * --------------------------------------------------------------------------------
  * Commands:
  * CL - Prints the first and last events related to a given customer
  * PC - Prints all events related to a given package
+ * CW - Same as CL, restricted to the events of a time window
+ * PW - Same as PC, restricted to the events of a time window
  * RG - Registers a new package in the system and stores the "Registration" event
  * AR - Stores the "Store" event
  * RM - Stores the "Remove" event
  * UR - Stores the "Restore" event
  * TR - Stores the "Transport" event
  * EN - Stores the "Delivery" event
+ * ST - Adds a stakeholder (a customer) to a package; from this event on, its CL
+ *      lists the package like the ones it sent or receives
+ * FZ - Freezes the current state into read-only CSR arrays (see csr_index.hpp);
+ *      CL and PC are answered from them until the next event thaws the state.
+ *      With --publish, the frozen state is also published to the replicas
+ * AG - Prints how many events of each type happened in a time window
+ * WT - Prints how many events of each type touched a warehouse in a time window
+ * WP - Prints the last event of every package currently in a given warehouse
+ * SP - Prints the last event of every package currently in a given section
+ * TC - Prints the k customers with the most packages not delivered yet
+ * TP - Prints the k packages with the most events (see ranking.hpp)
+ * --------------------------------------------------------------------------------
+ * Usage: main [options] <text file>...
+ * Several text files (one per warehouse, say) are each parsed on their own thread
+ * and merged by time stamp, ties in the order of the command line, as if they had
+ * been pre-merged into one chronological trace (see trace_merger.hpp). Binary
+ * traces (see trace_writer.hpp) are recognized by their header and may be mixed
+ * with text ones.
+ * --bulk - Scans the trace once before ingesting it and sizes the log store, the
+ *          tables and the node storage exactly once (see trace_reader.hpp)
+ * --cache <slots> - Caches up to <slots> rendered CL and PC answers of each kind,
+ *          invalidated whenever their thread changes (see query_cache.hpp)
+ * --threads <n> - Answers each run of consecutive CL, PC, CW and PW commands in
+ *          parallel on n threads, printing the answers in their original order
+ * --spill <path> - Moves the threads of the packages without events in the last
+ *          --spill-window <time> units (10000 by default) to a file mapped in
+ *          memory, keeping only their first and last nodes (see spill_store.hpp)
+ * --mem-report - Prints to stderr, at exit, the heap bytes of each structure and
+ *          how much of them is slack (capacity not holding data)
+ * --mem-budget <bytes> - Checks the heap bytes every MEMORY_CHECK_INTERVAL commands
+ *          (K, M and G suffixes allowed). Above the budget the caches and the frozen
+ *          index are dropped, the cold threads spilled and everything shrunk to fit;
+ *          if that is not enough, ingestion stops with exit status 2
+ * --server <socket> - After the trace (which is optional in this mode), keeps
+ *          serving command lines sent to a Unix domain socket, until SIGINT or
+ *          SIGTERM; see serve() below
+ * --schedule - With --server: events are applied by their own thread, and queries
+ *          are answered ahead of the queued events (see command_scheduler.hpp);
+ *          the queue and latency metrics are printed to stderr at exit
+ * --latency-target <us> - Query latency the --schedule mode aims at (1000
+ *          microseconds by default): while a query waits, the event thread holds
+ *          the state for at most a quarter of it; the metrics count the queries
+ *          over it (see command_scheduler.hpp)
+ * --publish <name> - Publishes the state to the POSIX shared-memory region <name>
+ *          at every FZ and at the end of the trace (see replica_region.hpp)
+ * --replica <name> - Read-only replica: answers the CL, PC, CW and PW commands of
+ *          the text file and/or the --server clients from the region <name>
+ *          published by another process; other commands are answered with an error
+ * --profile - Prints to stderr, at exit, the calls, time and hardware counters
+ *          (cycles, instructions, LLC and branch misses) of each command type and
+ *          of the update functions of the ETS, counted on the thread that ran them
+ *          (see perf_profiler.hpp)
+ * --convert <path> - Writes the commands of the text file(s), merged, to <path> as
+ *          a binary trace instead of running them
+ * --export <path> - After the trace, writes to <path> the CL answer of every
+ *          customer, sorted by name, rendered on the --threads workers; with
+ *          --export-packages, the PC answer of every package follows, by id
+ * --io <sync|uring> - With uring, the text trace files are read ahead and the
+ *          answers written out asynchronously through io_uring (see uring_io.hpp);
+ *          with --bulk the trace is mapped all the same. Where the kernel does not
+ *          provide it, the blocking I/O (sync) is used
  * 
  * ********************************************************************************
  *
@@ -121,396 +184,1701 @@
 #include "hash.hpp"
 #include "dimension_node.hpp"
 #include "linked_list.hpp"
+#include "node_pool.hpp"
+#include "thread_update.hpp"
+#include "csr_index.hpp"
+#include "trace_reader.hpp"
+#include "trace_merger.hpp"
+#include "trace_writer.hpp"
+#include "event_columns.hpp"
+#include "query_cache.hpp"
+#include "thread_pool.hpp"
+#include "command_scheduler.hpp"
+#include "ranking.hpp"
+#include "event_log.hpp"
+#include "format.hpp"
+#include "spill_store.hpp"
+#include "unix_server.hpp"
+#include "replica_region.hpp"
+#include "perf_profiler.hpp"
+#include "uring_io.hpp"
 
 #include <iostream>
-#include <sstream>
 #include <fstream>
 #include <string>
+#include <algorithm>
+#include <functional>
 #include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+
 
 
 
 
+// A customer whose thread follows a package, from the first event it took part in
+struct Stakeholder {
+    std::string name;
+    // Hash of the name, for the customer table and the dimension tables (see Hash::hashOf)
+    size_t hash = 0;
+    DimensionNode<int>* first = nullptr;
+    // Handle in the customer ranking, once the package counted for the customer
+    int rank = -1;
+};
+
+
+
 
 struct PackageData {
-    std::string sender;
-    std::string recipient;
+    // Sender and recipient, registered by RG, then the ones added by ST
+    ArrayList<Stakeholder> stakeholders = ArrayList<Stakeholder>(0);
     LinkedList<int> events;
+    // Node holding the package id in the "warehouse" and "section" dimensions
+    DimensionNode<int>* location = nullptr;
+    int warehouse = -1;
+    int section = -1;
+    // Whole package thread while it is spilled to disk
+    SpillSpan spill;
+    // Handle in the package ranking; whether the stakeholders count it as not delivered
+    int rank = -1;
+    bool active = false;
+};
+
+
+
+
+// Read-only copy of the customer and package threads, valid while no event arrives
+struct FrozenIndex {
+    bool frozen = false;
+    CsrIndex<std::string> customers;
+    CsrIndex<int> packages;
 };
 
 
 
 
-void handleActionCL(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, int i);
-void handleActionRG(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionAR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionRM(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionUR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionTR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionEN(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList);
-void handleActionPC(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<int, PackageData>& packages, int i);
-void updateLists(int i, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int packageID, LinkedList<int>& DNodesList);
-void updateCustomerList(std::string customer, DimensionNode<int>* DNode, DimensionNode<int>* newDNode, int eventsSize, LinkedList<int>* customerList);
-void updateDeleteList(LinkedList<int>& DNodesList, DimensionNode<int>* newDNode); 
-void updatePackageList(PackageData* packageData, DimensionNode<int>* newDNode);
+// Commands between two checks of the memory budget
+const int MEMORY_CHECK_INTERVAL = 1 << 16;
 
 
 
+// Every structure of the ETS, shared by the command handlers
+struct LogisticsSystem {
+    EventLog logs;
+    Hash<std::string, LinkedList<int>> customers;
+    Hash<int, PackageData> packages;
+    Hash<int, LinkedList<int>> warehouses;
+    Hash<size_t, LinkedList<int>> sections;
+    // Location nodes in the "recent" dimension, from the least recently touched package
+    LinkedList<int> recent;
+    NodePool<int> nodes;
+    FrozenIndex frozenIndex;
+    EventColumns columns;
+    QueryCache<std::string> customerCache;
+    QueryCache<int> packageCache;
+    SpillStore spillStore;
+    int spillWindow = 0;
+    ReplicaRegion replica;
+    PerfProfiler profiler;
+    // Packages not delivered yet per customer, and events per package
+    Ranking<std::string> customerRanks;
+    Ranking<int> packageRanks;
+    // Command index from which the memory budget is due for its next check
+    int nextMemoryCheck = MEMORY_CHECK_INTERVAL;
+
+    LogisticsSystem() : logs(1000), customers(1000), packages(1000), columns(1000) {};
+};
+
+
+
+
+// Dimensions of the location nodes, named once instead of at every event
+const std::string WAREHOUSE_DIMENSION = "warehouse";
+const std::string SECTION_DIMENSION = "section";
+
+
+
+// Commands decoded ahead of time, so their table slots are prefetched together
+const int APPLY_WINDOW = 16;
+
+
+
+// Output kept in memory before it is written to stdout
+const size_t OUTPUT_FLUSH_BYTES = 1 << 16;
+
+
+
+// Largest run of thread queries answered at once by the batch executor
+const int QUERY_BATCH_LIMIT = 4096;
 
-int main(int argc, char* argv[]) {
-    ArrayList<std::string> logs(1000);
-    Hash<std::string, LinkedList<int>> customers(1000);
-    Hash<int, PackageData> packages(1000);
-    LinkedList<int> DNodesList;
-    DimensionNode<int>* DNode = new DimensionNode<int>;
-    DNodesList.head = DNode; 
-    DNodesList.tail = DNode; 
-    
-    int time;
-    std::string command;
-    std::string action;
 
-    if (argc < 2) {
-        std::cerr << "Error: no text file!" << std::endl;
+
+// Customers or packages rendered per round of the export, which bounds its buffers
+const int EXPORT_ROUND = 4096;
+
+
+
+// Profiled regions: one per command type, then the ETS updates shared by the events
+const int PROFILE_RECORD = static_cast<int>(CommandType::TP) + 1;
+const int PROFILE_UPDATE_LISTS = PROFILE_RECORD + 1;
+const int PROFILE_UPDATE_CUSTOMER_LIST = PROFILE_RECORD + 2;
+const int PROFILE_UPDATE_PACKAGE_LIST = PROFILE_RECORD + 3;
+const int PROFILE_UPDATE_LOCATION = PROFILE_RECORD + 4;
+const int PROFILE_QUERY_BATCH = PROFILE_RECORD + 5;
+const int PROFILE_REGIONS = PROFILE_RECORD + 6;
+
+
+
+// Hashes of the keys an event looks up, computed once when it is decoded
+struct EventKeys {
+    size_t package = 0;
+    // Sender of RG, or customer of ST, then recipient of RG
+    size_t customer = 0;
+    size_t recipient = 0;
+};
+
+
+
+// A thread query waiting in a batch, with the answer rendered for it
+struct QueryJob {
+    Command command;
+    int i = 0;
+    std::string body;
+    bool fresh = false;
+};
+
+
+
+
+struct Options {
+    ArrayList<const char*> inputPaths;
+    bool bulkLoad = false;
+    int cacheSlots = 0;
+    int threads = 1;
+    const char* spillPath = nullptr;
+    int spillWindow = 10000;
+    bool memoryReport = false;
+    size_t memoryBudget = 0;
+    const char* serverPath = nullptr;
+    const char* publishName = nullptr;
+    const char* replicaName = nullptr;
+    const char* convertPath = nullptr;
+    bool profile = false;
+    bool schedule = false;
+    int latencyTarget = 1000;
+    const char* exportPath = nullptr;
+    bool exportPackages = false;
+    IoBackend io = IoBackend::SYNC;
+};
+
+
+
+
+bool parseOptions(int argc, char* argv[], Options& options);
+bool parseBytes(const char* text, size_t& bytes);
+void presize(TraceMerger& trace, LogisticsSystem& ets);
+int replayTrace(TraceMerger& trace, const Options& options, LogisticsSystem& ets);
+int convertTrace(TraceMerger& trace, const char* path);
+void recordCommand(const Command& command, LogisticsSystem& ets);
+void executeCommand(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i, std::string& out);
+int serve(const Options& options, LogisticsSystem& ets);
+int serveScheduled(const Options& options, LogisticsSystem& ets);
+void applyClientCommand(const Command& command, const Options& options, LogisticsSystem& ets, bool& ingesting, std::string& out);
+void printSchedulerMetrics(const SchedulerMetrics& metrics, int latencyTarget);
+int runServer(const char* path, const UnixServer::LineHandler& handler);
+bool parseLine(const char* line, size_t length, Command& command, std::string& out);
+int readWindow(TraceMerger& trace, ArrayList<Command>& window);
+void prefetchWindow(const LogisticsSystem& ets, const ArrayList<Command>& window, ArrayList<EventKeys>& keys, int count);
+void hashKeys(const Command& command, const LogisticsSystem& ets, EventKeys& keys);
+void handleQuery(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+bool answerQuery(const Command& command, const LogisticsSystem& ets, std::string& body);
+void cacheAnswer(const Command& command, LogisticsSystem& ets, const std::string& body);
+void runQueryBatch(ArrayList<QueryJob>& batch, LogisticsSystem& ets, ThreadPool& pool, std::string& out);
+int exportViews(const Options& options, const LogisticsSystem& ets);
+void exportRounds(ThreadPool& pool, int count, const std::function<void(int, std::string&)>& render, std::ofstream& file);
+void renderCustomer(const LogisticsSystem& ets, const std::string& customerName, const LinkedList<int>* customerPackages, std::string& body);
+void renderPackage(const LogisticsSystem& ets, int packageId, const PackageData* packageData, std::string& body);
+void collectWindow(const EventColumns& columns, const DimensionNode<int>* tail, const std::string& dimension, int windowBegin, int windowEnd, ArrayList<int>& window);
+void collectWindow(const EventColumns& columns, CsrSpan span, int windowBegin, int windowEnd, ArrayList<int>& window);
+void renderWindow(const LogisticsSystem& ets, const ArrayList<int>& window, std::string& body);
+void handleActionRG(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionAR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionRM(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionUR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionTR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionEN(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionST(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i);
+void handleActionFZ(LogisticsSystem& ets);
+void publishReplica(LogisticsSystem& ets);
+int runReplica(TraceMerger& trace, const Options& options);
+void answerReplicaQuery(const Command& command, ReplicaRegion& replica, std::string& out);
+bool renderReplica(const Command& command, const ReplicaRegion& replica, std::string& body);
+void handleActionAG(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void handleActionWT(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void printTypeCounts(const LogisticsSystem& ets, int windowBegin, int windowEnd, int warehouse, std::string& out);
+void handleActionWP(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void handleActionSP(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void handleActionTC(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void handleActionTP(const Command& command, LogisticsSystem& ets, int i, std::string& out);
+void updateRanks(const Command& command, LogisticsSystem& ets, PackageData* packageData);
+void printLocationList(const LogisticsSystem& ets, const LinkedList<int>* locationList, const std::string& dimension, std::string& out);
+void freeze(Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, const SpillStore& spillStore, FrozenIndex& frozenIndex);
+void thaw(FrozenIndex& frozenIndex);
+PackageData* updateLists(int i, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int packageId, size_t packageHash, NodePool<int>& nodes, PerfProfiler& profiler);
+void updateLocation(LogisticsSystem& ets, PackageData* packageData, int packageId, int warehouse, int section);
+void unlinkNode(LinkedList<int>* list, DimensionNode<int>* DNode, const std::string& dimension);
+void appendNode(LinkedList<int>* list, DimensionNode<int>* DNode, const std::string& dimension);
+size_t sectionKey(int warehouse, int section);
+void touchPackage(LogisticsSystem& ets, int packageId);
+void spillColdPackages(LogisticsSystem& ets, int now);
+void spillPackage(LogisticsSystem& ets, PackageData* packageData);
+void restorePackage(LogisticsSystem& ets, int packageId);
+CsrSpan spilledSpan(const LogisticsSystem& ets, const PackageData* packageData);
+size_t heapBytes(const Stakeholder& stakeholder);
+size_t heapBytes(const PackageData& packageData);
+MemoryUsage measureMemory(const LogisticsSystem& ets, bool report);
+bool enforceBudget(LogisticsSystem& ets, size_t budget);
+void shrinkToFit(LogisticsSystem& ets);
+void printProfile(const PerfProfiler& profiler);
+
+
+
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--bulk] [--cache <slots>] [--threads <n>] [--spill <path> [--spill-window <time>]]"
+                  << " [--mem-report] [--mem-budget <bytes>] [--server <socket> [--schedule [--latency-target <us>]]] [--publish <name> | --replica <name>] [--convert <path>] [--profile] [--export <path> [--export-packages]] [--io sync|uring] <text file>..." << std::endl;
         return 1; 
     }
+    if (options.io == IoBackend::URING) {
+        IoRing probe;
+        if (!probe.open(2)) {
+            std::cerr << "Warning: io_uring unavailable (" << strerror(errno) << "); using blocking I/O" << std::endl;
+            options.io = IoBackend::SYNC;
+        }
+    }
 
-    std::ifstream inputFile(argv[1]);
-    if (!inputFile.is_open()) {
-        std::cerr << "Error: could not open file: '" << argv[1] << "'" << std::endl;
+    // The bulk-load mode reads the trace twice, so it maps it instead of reading it ahead
+    IoBackend input = options.bulkLoad ? IoBackend::SYNC : options.io;
+    TraceMerger trace;
+    for (int k = 0; k < options.inputPaths.getSize(); k++) {
+        if (trace.open(options.inputPaths[k], input)) continue;
+        std::cerr << "Error: could not open file: '" << options.inputPaths[k] << "'" << std::endl;
         return 1;
     }
-    
-    for (int i = 0; inputFile >> time; i++) {
-        inputFile >> command;
-
-        if (command == "CL") {
-            handleActionCL(time, inputFile, logs, customers, i);
-        } 
-        else if (command == "EV") {
-            inputFile >> action;
-
-            if (action == "RG") {
-                handleActionRG(time, inputFile, logs, customers, packages, i, DNodesList);
-            } else if (action == "AR") {
-                handleActionAR(time, inputFile, logs, customers, packages, i, DNodesList);
-            } else if (action == "RM") {
-                handleActionRM(time, inputFile, logs, customers, packages, i, DNodesList);
-            } else if (action == "UR") {
-                handleActionUR(time, inputFile, logs, customers, packages, i, DNodesList);
-            } else if (action == "TR") {
-                handleActionTR(time, inputFile, logs, customers, packages, i, DNodesList);
-            } else if (action == "EN") {
-                handleActionEN(time, inputFile, logs, customers, packages, i, DNodesList);
-            }
-        } 
-        else if (command == "PC") {
-            handleActionPC(time, inputFile, logs, packages, i);
+    if (options.convertPath != nullptr) return convertTrace(trace, options.convertPath);
+    if (options.replicaName != nullptr) return runReplica(trace, options);
+
+    LogisticsSystem ets;
+    if (options.bulkLoad && trace.getSize() > 0) presize(trace, ets);
+    if (options.cacheSlots > 0) {
+        ets.customerCache = QueryCache<std::string>(options.cacheSlots);
+        ets.packageCache = QueryCache<int>(options.cacheSlots);
+    }
+    if (options.spillPath != nullptr) {
+        if (!ets.spillStore.open(options.spillPath)) {
+            std::cerr << "Error: could not create spill file: '" << options.spillPath << "'" << std::endl;
+            return 1;
         }
+        ets.spillWindow = options.spillWindow;
     }
+    if (options.publishName != nullptr && !ets.replica.create(options.publishName)) {
+        std::cerr << "Error: could not create shared memory region: '" << options.publishName << "'" << std::endl;
+        return 1;
+    }
+    if (options.profile && !ets.profiler.open(PROFILE_REGIONS))
+        std::cerr << "Warning: hardware counters unavailable (" << strerror(errno) << "); profiling calls and time only" << std::endl;
+
+    int status = (trace.getSize() > 0) ? replayTrace(trace, options, ets) : 0;
+    if (status == 0 && ets.replica.enabled()) publishReplica(ets);
+    if (status == 0 && options.exportPath != nullptr) status = exportViews(options, ets);
+    if (status == 0 && options.serverPath != nullptr) status = serve(options, ets);
+    if (options.memoryReport) measureMemory(ets, true);
+    if (options.profile) printProfile(ets.profiler);
+
+    return status;
+}
+
+
+
+
+// Ingests the whole trace, printing the answers to stdout; returns the exit status
+int replayTrace(TraceMerger& trace, const Options& options, LogisticsSystem& ets) {
+    ThreadPool pool(options.threads);
+    ArrayList<QueryJob> batch(QUERY_BATCH_LIMIT);
+    ArrayList<Command> window(0);
+    window.assign(APPLY_WINDOW, Command());
+    ArrayList<EventKeys> keys(0);
+    keys.assign(APPLY_WINDOW, EventKeys());
+    std::string output;
+    OutputWriter writer(options.io);
+
+    int i = 0;
+    for (int count = readWindow(trace, window); count > 0; count = readWindow(trace, window)) {
+        prefetchWindow(ets, window, keys, count);
+
+        for (int k = 0; k < count; k++, i++) {
+            const Command& command = window[k];
+
+            if (options.memoryBudget > 0 && i >= ets.nextMemoryCheck) {
+                ets.nextMemoryCheck = i + MEMORY_CHECK_INTERVAL;
+                if (!batch.isEmpty()) runQueryBatch(batch, ets, pool, output);
+                if (!enforceBudget(ets, options.memoryBudget)) {
+                    writer.write(output);
+                    writer.finish();
+                    std::cerr << "Error: memory budget of " << options.memoryBudget 
+                              << " bytes exceeded; ingestion stopped at command " << i << std::endl;
+                    return 2;
+                }
+            }
 
-    DimensionNode<int>* current = DNodesList.head;
-    DimensionNode<int>* temp = current;
-    while (current != nullptr) {
-        temp = current->dimension["delete"].next;
-        delete current;
-        current = temp;
+            recordCommand(command, ets);
+
+            if (pool.getSize() > 1 && command.isThreadQuery()) {
+                QueryJob job;
+                job.command = command;
+                job.i = i;
+                batch.insertAtEnd(job);
+                if (batch.getSize() == QUERY_BATCH_LIMIT) runQueryBatch(batch, ets, pool, output);
+                continue;
+            }
+            if (!batch.isEmpty()) runQueryBatch(batch, ets, pool, output);
+
+            executeCommand(command, keys[k], ets, i, output);
+            if (output.size() >= OUTPUT_FLUSH_BYTES) writer.write(output);
+        }
     }
+    if (!batch.isEmpty()) runQueryBatch(batch, ets, pool, output);
+    writer.write(output);
 
     return 0;
+};
+
+
+
+// Re-encodes the trace as a binary one, without running it
+int convertTrace(TraceMerger& trace, const char* path) {
+    TraceWriter writer;
+    Command command;
+    while (trace.next(command)) writer.append(command);
+
+    if (writer.save(path)) return 0;
+    std::cerr << "Error: could not write file: '" << path << "'" << std::endl;
+    return 1;
+};
+
+
+
+// Stores the command in the logs and the columns, under the next command index
+void recordCommand(const Command& command, LogisticsSystem& ets) {
+    ProfileScope scope(ets.profiler, PROFILE_RECORD);
+    if (command.isEvent()) {
+        thaw(ets.frozenIndex);
+        if (ets.spillStore.enabled()) restorePackage(ets, command.packageId);
+    }
+    ets.logs.append(command);
+    ets.columns.append(command);
+};
+
+
+
+// Applies the command recorded under index i, appending whatever it prints to out
+void executeCommand(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i, std::string& out) {
+    ProfileScope scope(ets.profiler, static_cast<int>(command.type));
+    switch (command.type) {
+        case CommandType::CL:
+        case CommandType::PC:
+        case CommandType::CW:
+        case CommandType::PW: handleQuery(command, ets, i, out); break;
+        case CommandType::FZ: handleActionFZ(ets); break;
+        case CommandType::AG: handleActionAG(command, ets, i, out); break;
+        case CommandType::WT: handleActionWT(command, ets, i, out); break;
+        case CommandType::WP: handleActionWP(command, ets, i, out); break;
+        case CommandType::SP: handleActionSP(command, ets, i, out); break;
+        case CommandType::TC: handleActionTC(command, ets, i, out); break;
+        case CommandType::TP: handleActionTP(command, ets, i, out); break;
+        case CommandType::RG: handleActionRG(command, keys, ets, i); break;
+        case CommandType::AR: handleActionAR(command, keys, ets, i); break;
+        case CommandType::RM: handleActionRM(command, keys, ets, i); break;
+        case CommandType::UR: handleActionUR(command, keys, ets, i); break;
+        case CommandType::TR: handleActionTR(command, keys, ets, i); break;
+        case CommandType::EN: handleActionEN(command, keys, ets, i); break;
+        case CommandType::ST: handleActionST(command, keys, ets, i); break;
+        // Only logged, as an empty line, to keep logs[i] aligned with the command index
+        case CommandType::UNKNOWN: break;
+    }
+
+    if (command.isEvent() && ets.spillStore.enabled()) {
+        touchPackage(ets, command.packageId);
+        spillColdPackages(ets, command.time);
+    }
+};
+
+
+
+/* Server mode: after the trace, the same ETS keeps answering the command lines of
+*  the clients of a Unix domain socket (see unix_server.hpp). Each line is applied
+*  exactly as if it were the next line of the trace, and answered with what the
+*  trace would have printed for it, so events get no answer. Lines that are not a
+*  valid command are answered with an error line and leave the state untouched.
+*/
+int serve(const Options& options, LogisticsSystem& ets) {
+    if (options.schedule) return serveScheduled(options, ets);
+
+    bool ingesting = true;
+    return runServer(options.serverPath, [&](const UnixServer::Client&, const char* line, size_t length, std::string& out) {
+        Command command;
+        if (parseLine(line, length, command, out)) applyClientCommand(command, options, ets, ingesting, out);
+    });
+};
+
+
+
+/* Server mode with --schedule: the loop thread parses the lines and answers the
+*  queries itself, ahead of the events queued for the event thread. A client with
+*  lines still queued has the following ones queued as well, so it always reads its
+*  own events and gets its answers in order.
+*/
+int serveScheduled(const Options& options, LogisticsSystem& ets) {
+    UnixServer server;
+    if (!server.open(options.serverPath)) {
+        std::cerr << "Error: could not listen on socket: '" << options.serverPath << "'" << std::endl;
+        return 1;
+    }
+
+    bool ingesting = true;
+    CommandScheduler scheduler(options.latencyTarget);
+    scheduler.start([&](const ScheduledCommand& job, std::string& out) {
+        if (!job.error.empty()) out += job.error;
+        else applyClientCommand(job.command, options, ets, ingesting, out);
+    }, [&](const UnixServer::Client& client, const std::string& answer) {
+        server.post(client, answer);
+    });
+
+    bool served = server.run([&](const UnixServer::Client& client, const char* line, size_t length, std::string& out) {
+        ScheduledCommand job;
+        job.issued = SchedulerClock::now();
+        job.client = client;
+        bool valid = parseLine(line, length, job.command, job.error);
+        if (!valid && job.error.empty()) return;
+
+        if (!server.hasPending(client) && !(valid && job.command.isEvent())) {
+            if (!valid) {
+                out += job.error;
+                return;
+            }
+            SchedulerPriority priority(scheduler);
+            applyClientCommand(job.command, options, ets, ingesting, out);
+            scheduler.recordQuery(job.issued, false);
+            return;
+        }
+        server.defer(client);
+        scheduler.submit(job);
+    });
+
+    scheduler.stop();
+    printSchedulerMetrics(scheduler.metrics(), options.latencyTarget);
+    return served ? 0 : 1;
+};
+
+
+
+// Applies a command line of a client exactly as if it were the next line of the trace
+void applyClientCommand(const Command& command, const Options& options, LogisticsSystem& ets, bool& ingesting, std::string& out) {
+    int i = ets.logs.getSize();
+    // Due on whatever line crosses the threshold, so a stream of queries cannot skip it
+    if (options.memoryBudget > 0 && i >= ets.nextMemoryCheck) {
+        ets.nextMemoryCheck = i + MEMORY_CHECK_INTERVAL;
+        ingesting = ingesting && enforceBudget(ets, options.memoryBudget);
+    }
+    if (command.isEvent() && !ingesting) {
+        out += "ERROR memory budget exceeded\n";
+        return;
+    }
+
+    EventKeys keys;
+    if (command.isEvent()) hashKeys(command, ets, keys);
+    recordCommand(command, ets);
+    executeCommand(command, keys, ets, i, out);
+};
+
+
+
+
+int runServer(const char* path, const UnixServer::LineHandler& handler) {
+    UnixServer server;
+    if (!server.open(path)) {
+        std::cerr << "Error: could not listen on socket: '" << path << "'" << std::endl;
+        return 1;
+    }
+    return server.run(handler) ? 0 : 1;
+};
+
+
+
+// Decodes a command line sent to the server; malformed lines get an error line, blank ones nothing
+bool parseLine(const char* line, size_t length, Command& command, std::string& out) {
+    TraceReader lineReader;
+    lineReader.openBuffer(line, length);
+    if (lineReader.next(command) && command.type != CommandType::UNKNOWN) return true;
+
+    size_t k = 0;
+    while (k < length && isspace(static_cast<unsigned char>(line[k]))) k++;
+    if (k < length) out += "ERROR malformed command\n";
+    return false;
+};
+
+
+
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--bulk") == 0) options.bulkLoad = true;
+        else if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc) options.cacheSlots = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) options.threads = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--spill") == 0 && arg + 1 < argc) options.spillPath = argv[++arg];
+        else if (strcmp(argv[arg], "--spill-window") == 0 && arg + 1 < argc) options.spillWindow = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--mem-report") == 0) options.memoryReport = true;
+        else if (strcmp(argv[arg], "--server") == 0 && arg + 1 < argc) options.serverPath = argv[++arg];
+        else if (strcmp(argv[arg], "--mem-budget") == 0 && arg + 1 < argc) {
+            if (!parseBytes(argv[++arg], options.memoryBudget)) return false;
+        }
+        else if (strcmp(argv[arg], "--publish") == 0 && arg + 1 < argc) options.publishName = argv[++arg];
+        else if (strcmp(argv[arg], "--replica") == 0 && arg + 1 < argc) options.replicaName = argv[++arg];
+        else if (strcmp(argv[arg], "--convert") == 0 && arg + 1 < argc) options.convertPath = argv[++arg];
+        else if (strcmp(argv[arg], "--profile") == 0) options.profile = true;
+        else if (strcmp(argv[arg], "--schedule") == 0) options.schedule = true;
+        else if (strcmp(argv[arg], "--export") == 0 && arg + 1 < argc) options.exportPath = argv[++arg];
+        else if (strcmp(argv[arg], "--export-packages") == 0) options.exportPackages = true;
+        else if (strcmp(argv[arg], "--latency-target") == 0 && arg + 1 < argc) options.latencyTarget = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--io") == 0 && arg + 1 < argc) {
+            const char* backend = argv[++arg];
+            if (strcmp(backend, "uring") == 0) options.io = IoBackend::URING;
+            else if (strcmp(backend, "sync") != 0) return false;
+        }
+        else if (strncmp(argv[arg], "--", 2) == 0) return false;
+        else options.inputPaths.insertAtEnd(argv[arg]);
+    }
+    if (options.publishName != nullptr && options.replicaName != nullptr) return false;
+    if (options.schedule && (options.serverPath == nullptr || options.replicaName != nullptr)) return false;
+    if (options.exportPackages && options.exportPath == nullptr) return false;
+    if (options.convertPath != nullptr) return !options.inputPaths.isEmpty();
+    return !options.inputPaths.isEmpty() || options.serverPath != nullptr;
 }
 
 
 
+/* Positive byte count with an optional K, M or G suffix (powers of 1024); false for
+*  anything else, including zero (no budget), signs, other suffixes and counts that
+*  do not fit in a size_t.
+*/
+bool parseBytes(const char* text, size_t& bytes) {
+    if (*text < '0' || *text > '9') return false;
 
-void handleActionRG(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, originWarehouseId, destinationWarehouseId;
-    std::string sender, recipient;
-    
-    inputFile 
-        >> packageId 
-        >> sender 
-        >> recipient 
-        >> originWarehouseId 
-        >> destinationWarehouseId;
-
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV RG " 
-        << std::setw(3) << packageId << " " 
-        << sender << " " 
-        << recipient << " " 
-        << std::setw(3) << originWarehouseId << " " 
-        << std::setw(3) << destinationWarehouseId;
-    logs.insertAtEnd(logStream.str());
-
-    PackageData* packageData = &packages[packageId];
-    packageData->sender = sender;
-    packageData->recipient = recipient;
+    char* suffix = nullptr;
+    errno = 0;
+    unsigned long long count = strtoull(text, &suffix, 10);
+    if (errno == ERANGE || count == 0 || count > SIZE_MAX) return false;
+
+    int shift = 0;
+    switch (*suffix) {
+        case '\0': break;
+        case 'K': case 'k': shift = 10; break;
+        case 'M': case 'm': shift = 20; break;
+        case 'G': case 'g': shift = 30; break;
+        default: return false;
+    }
+    if (shift > 0 && suffix[1] != '\0') return false;
+    if (count > (SIZE_MAX >> shift)) return false;
+
+    bytes = static_cast<size_t>(count) << shift;
+    return true;
+}
+
+
+
+// Decodes up to APPLY_WINDOW commands into the window, reusing its slots
+int readWindow(TraceMerger& trace, ArrayList<Command>& window) {
+    int count = 0;
+    while (count < window.getSize() && trace.next(window[count])) count++;
+    return count;
+};
+
+
+
+/* Group prefetching: the table slots the events of the window are about to touch
+*  are requested up front, so their cache misses overlap instead of being paid one
+*  event at a time. First the package slots (and the customer slots of RG and ST,
+*  whose names are in the command), then, with the packages now at hand, the slots
+*  of all their stakeholders and the last node of each package. Prefetching never
+*  changes the state: the commands are still applied one by one, in order.
+*  The hashes of the keys are left in keys, and the events are applied with them;
+*  those of the stakeholders are kept by the packages.
+*/
+void prefetchWindow(const LogisticsSystem& ets, const ArrayList<Command>& window, ArrayList<EventKeys>& keys, int count) {
+    for (int k = 0; k < count; k++) {
+        const Command& command = window[k];
+        if (!command.isEvent()) continue;
+        hashKeys(command, ets, keys[k]);
+        ets.packages.prefetchHash(keys[k].package);
+        if (command.type == CommandType::RG) {
+            ets.customers.prefetchHash(keys[k].customer);
+            ets.customers.prefetchHash(keys[k].recipient);
+        } else if (command.type == CommandType::ST) {
+            ets.customers.prefetchHash(keys[k].customer);
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        const Command& command = window[k];
+        if (!command.isEvent() || command.type == CommandType::RG) continue;
+        const PackageData* packageData = ets.packages.find(command.packageId, keys[k].package);
+        if (packageData == nullptr) continue;
+        for (int s = 0; s < packageData->stakeholders.getSize(); s++)
+            ets.customers.prefetchHash(packageData->stakeholders[s].hash);
+        __builtin_prefetch(packageData->events.tail);
+    }
+};
+
+
+
+
+void hashKeys(const Command& command, const LogisticsSystem& ets, EventKeys& keys) {
+    keys.package = ets.packages.hashOf(command.packageId);
+    if (command.type == CommandType::RG) {
+        keys.customer = ets.customers.hashOf(command.sender);
+        keys.recipient = ets.customers.hashOf(command.recipient);
+    } else if (command.type == CommandType::ST) {
+        keys.customer = ets.customers.hashOf(command.customerName);
+    }
+};
+
+
+
+/* Bulk-load mode: a first pass over the mapped trace sizes the log store, the
+*  tables, the rankings and the node storage exactly once, so none of them grows
+*  while ingesting. Every event takes a node, and every package one more for its
+*  location.
+*/
+void presize(TraceMerger& trace, LogisticsSystem& ets) {
+    TraceStats stats = trace.scan();
+
+    ets.logs.reserve(stats.commands);
+    ets.columns.reserve(stats.commands, stats.events);
+    ets.customers.reserve(stats.customers);
+    ets.packages.reserve(stats.packages);
+    ets.customerRanks.reserve(stats.customers);
+    ets.packageRanks.reserve(stats.packages);
+    ets.nodes.reserve(stats.events + stats.packages);
+}
+
+
+
+
+void handleActionRG(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    PackageData* packageData = &ets.packages.get(command.packageId, keys.package);
     
-    DimensionNode<int>* newDNode = new DimensionNode<int>;
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    DimensionNode<int>* newDNode = ets.nodes.allocate();
     newDNode->item = i;
 
-    updateCustomerList(sender, nullptr, newDNode, packageData->events.getSize(), &customers[sender]);
-    
-    updateCustomerList(recipient, nullptr, newDNode, packageData->events.getSize(), &customers[recipient]);
-    
-    updatePackageList(packageData, newDNode);
+    packageData->stakeholders = ArrayList<Stakeholder>(2);
+    packageData->stakeholders.insertAtEnd(Stakeholder{command.sender, keys.customer, newDNode});
+    packageData->stakeholders.insertAtEnd(Stakeholder{command.recipient, keys.recipient, newDNode});
+
+    {
+        ProfileScope scope(ets.profiler, PROFILE_UPDATE_CUSTOMER_LIST);
+        updateCustomerList(command.sender, keys.customer, nullptr, newDNode, newDNode, &ets.customers.get(command.sender, keys.customer));
+    }
+    {
+        ProfileScope scope(ets.profiler, PROFILE_UPDATE_CUSTOMER_LIST);
+        updateCustomerList(command.recipient, keys.recipient, nullptr, newDNode, newDNode, &ets.customers.get(command.recipient, keys.recipient));
+    }
+    {
+        ProfileScope scope(ets.profiler, PROFILE_UPDATE_PACKAGE_LIST);
+        updatePackageList(&packageData->events, newDNode);
+    }
+    threads.stop();
 
-    updateDeleteList(DNodesList, newDNode);
+    updateLocation(ets, packageData, command.packageId, command.originWarehouseId, -1);
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionAR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, destinationWarehouseId, targetSection;
+void handleActionAR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    threads.stop();
 
-    inputFile 
-        >> packageId 
-        >> destinationWarehouseId 
-        >> targetSection;
-    
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV AR "
-        << std::setw(3) << packageId << " " 
-        << std::setw(3) << destinationWarehouseId << " " 
-        << std::setw(3) << targetSection;
-    logs.insertAtEnd(logStream.str());
-
-    updateLists(i, customers, packages, packageId, DNodesList);
+    updateLocation(ets, packageData, command.packageId, command.destinationWarehouseId, command.targetSection);
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionRM(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, destinationWarehouseId, targetSection;
+void handleActionRM(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    threads.stop();
 
-    inputFile 
-        >> packageId 
-        >> destinationWarehouseId 
-        >> targetSection;
-    
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV RM "
-        << std::setw(3) << packageId << " " 
-        << std::setw(3) << destinationWarehouseId << " " 
-        << std::setw(3) << targetSection;
-    logs.insertAtEnd(logStream.str());
-
-    updateLists(i, customers, packages, packageId, DNodesList);
+    updateLocation(ets, packageData, command.packageId, command.destinationWarehouseId, -1);
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionUR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, destinationWarehouseId, targetSection;
+void handleActionUR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    threads.stop();
 
-    inputFile 
-        >> packageId 
-        >> destinationWarehouseId 
-        >> targetSection;
-    
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV UR "
-        << std::setw(3) << packageId << " " 
-        << std::setw(3) << destinationWarehouseId << " " 
-        << std::setw(3) << targetSection;
-    logs.insertAtEnd(logStream.str());
-
-    updateLists(i, customers, packages, packageId, DNodesList);
+    updateLocation(ets, packageData, command.packageId, command.destinationWarehouseId, command.targetSection);
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionTR(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, originWarehouseId, destinationWarehouseId;
+void handleActionTR(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    threads.stop();
 
-    inputFile 
-    >> packageId 
-    >> originWarehouseId 
-    >> destinationWarehouseId;
-    
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV TR "
-        << std::setw(3) << packageId << " " 
-        << std::setw(3) << originWarehouseId << " " 
-        << std::setw(3) << destinationWarehouseId;
-    
-    logs.insertAtEnd(logStream.str());
-    
-    updateLists(i, customers, packages, packageId, DNodesList);
+    updateLocation(ets, packageData, command.packageId, -1, -1);
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionEN(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int i, LinkedList<int>& DNodesList) {
-    int packageId, destinationWarehouseId;
+void handleActionEN(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    threads.stop();
 
-    inputFile 
-        >> packageId 
-        >> destinationWarehouseId;
+    updateLocation(ets, packageData, command.packageId, -1, -1);
+    updateRanks(command, ets, packageData);
+}
 
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(7) << time << " EV EN " 
-        << std::setw(3) << packageId << " " 
-        << std::setw(3) << destinationWarehouseId;
-    logs.insertAtEnd(logStream.str());
 
-    updateLists(i, customers, packages, packageId, DNodesList);
+
+
+/* The event reaches the package and every current stakeholder like any other, then
+*  starts the thread of the new one; the package does not move. A customer that is
+*  already a stakeholder of the package is left as it is.
+*/
+void handleActionST(const Command& command, const EventKeys& keys, LogisticsSystem& ets, int i) {
+    ProfileScope threads(ets.profiler, PROFILE_UPDATE_LISTS);
+    PackageData* packageData = updateLists(i, ets.customers, ets.packages, command.packageId, keys.package, ets.nodes, ets.profiler);
+    bool known = false;
+    for (int k = 0; k < packageData->stakeholders.getSize() && !known; k++)
+        known = (packageData->stakeholders[k].name == command.customerName);
+
+    if (!known) {
+        DimensionNode<int>* newDNode = packageData->events.tail;
+        packageData->stakeholders.insertAtEnd(Stakeholder{command.customerName, keys.customer, newDNode});
+        ProfileScope scope(ets.profiler, PROFILE_UPDATE_CUSTOMER_LIST);
+        updateCustomerList(command.customerName, keys.customer, nullptr, newDNode, newDNode, &ets.customers.get(command.customerName, keys.customer));
+    }
+    threads.stop();
+
+    updateRanks(command, ets, packageData);
 }
 
 
 
 
-void handleActionCL(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<std::string, LinkedList<int>>& customers, int i) {
-    std::string customerName;
-    inputFile >> customerName;
+void handleQuery(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    std::string body;
+    if (answerQuery(command, ets, body)) cacheAnswer(command, ets, body);
 
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(6) << time << " CL " 
-        << customerName;
-    logs.insertAtEnd(logStream.str());
+    ets.logs.render(i, out);
+    out += '\n';
+    out += body;
+};
 
-    LinkedList<int>* customerPackages = &customers[customerName];
-    
-    std::cout 
-    << logs[i] << std::endl
-    << customerPackages->getSize() << std::endl;
-    
-    if ( customerPackages->getSize() < 1) return;
-    else {
-        DimensionNode<int>* DNode = customerPackages->head;
-        do {
-            std::cout << logs[(*DNode).item] << std::endl;
-            DNode = DNode->dimension[customerName].next;
-        } while (DNode != nullptr); 
+
+
+/* Renders the answer of a CL, PC, CW or PW command into body.
+*  Only reads the state, so queries may run concurrently between two events.
+*  Returns true when the body was rendered anew and can be cached.
+*/
+bool answerQuery(const Command& command, const LogisticsSystem& ets, std::string& body) {
+    ArrayList<int> window;
+
+    switch (command.type) {
+        case CommandType::CL: {
+            const LinkedList<int>* customerPackages = ets.customers.find(command.customerName);
+            if (customerPackages == nullptr) {
+                body = "0\n";
+                return false;
+            }
+            const std::string* cached = ets.customerCache.find(command.customerName, customerPackages->version);
+            if (cached != nullptr) {
+                body = *cached;
+                return false;
+            }
+            renderCustomer(ets, command.customerName, customerPackages, body);
+            return ets.customerCache.enabled();
+        }
+        case CommandType::PC: {
+            const PackageData* packageData = ets.packages.find(command.packageId);
+            if (packageData == nullptr) {
+                body = "0\n";
+                return false;
+            }
+            const std::string* cached = ets.packageCache.find(command.packageId, packageData->events.version);
+            if (cached != nullptr) {
+                body = *cached;
+                return false;
+            }
+            renderPackage(ets, command.packageId, packageData, body);
+            return ets.packageCache.enabled();
+        }
+        case CommandType::CW:
+            if (ets.frozenIndex.frozen) {
+                CsrSpan span = ets.frozenIndex.customers.find(command.customerName);
+                collectWindow(ets.columns, span, command.windowBegin, command.windowEnd, window);
+            } else {
+                const LinkedList<int>* customerPackages = ets.customers.find(command.customerName);
+                if (customerPackages != nullptr)
+                    collectWindow(ets.columns, customerPackages->tail, command.customerName, command.windowBegin, command.windowEnd, window);
+            }
+            renderWindow(ets, window, body);
+            return false;
+        case CommandType::PW:
+            if (ets.frozenIndex.frozen) {
+                CsrSpan span = ets.frozenIndex.packages.find(command.packageId);
+                collectWindow(ets.columns, span, command.windowBegin, command.windowEnd, window);
+            } else {
+                const PackageData* packageData = ets.packages.find(command.packageId);
+                if (packageData != nullptr && packageData->spill.offset >= 0)
+                    collectWindow(ets.columns, spilledSpan(ets, packageData), command.windowBegin, command.windowEnd, window);
+                else if (packageData != nullptr)
+                    collectWindow(ets.columns, packageData->events.tail, "package", command.windowBegin, command.windowEnd, window);
+            }
+            renderWindow(ets, window, body);
+            return false;
+        default:
+            return false;
+    }
+};
+
+
+
+
+void cacheAnswer(const Command& command, LogisticsSystem& ets, const std::string& body) {
+    if (command.type == CommandType::CL) {
+        const LinkedList<int>* customerPackages = ets.customers.find(command.customerName);
+        ets.customerCache.store(command.customerName, customerPackages->version, body);
+    } else if (command.type == CommandType::PC) {
+        const PackageData* packageData = ets.packages.find(command.packageId);
+        ets.packageCache.store(command.packageId, packageData->events.version, body);
+    }
+};
+
+
+
+/* Parallel batch executor: a run of thread queries with no event between them
+*  sees one unchanged state, so their answers are rendered concurrently and then
+*  written, and cached, in their original order.
+*/
+void runQueryBatch(ArrayList<QueryJob>& batch, LogisticsSystem& ets, ThreadPool& pool, std::string& out) {
+    // The whole batch, on the calling thread; each answer is also a call of its command type, on the thread that rendered it
+    ProfileScope scope(ets.profiler, PROFILE_QUERY_BATCH);
+    const LogisticsSystem& state = ets;
+    PerfProfiler& profiler = ets.profiler;
+    pool.run(batch.getSize(), [&](int k) {
+        ProfileScope query(profiler, static_cast<int>(batch[k].command.type));
+        batch[k].fresh = answerQuery(batch[k].command, state, batch[k].body);
+    });
+
+    for (int k = 0; k < batch.getSize(); k++) {
+        if (batch[k].fresh) cacheAnswer(batch[k].command, ets, batch[k].body);
+        ets.logs.render(batch[k].i, out);
+        out += '\n';
+        out += batch[k].body;
+    }
+    batch.clear();
+};
+
+
+
+/* Full report: the answer CL would give for every customer, under a "CL <name>"
+*  line and sorted by name, then optionally the PC answer of every package, by id.
+*  It reads the same state as the queries, without going through the trace.
+*/
+int exportViews(const Options& options, const LogisticsSystem& ets) {
+    std::ofstream file(options.exportPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error: could not create export file: '" << options.exportPath << "'" << std::endl;
+        return 1;
+    }
+    ThreadPool pool(options.threads);
+
+    ArrayList<const std::string*> names(static_cast<int>(ets.customers.size()));
+    ets.customers.forEach([&](const std::string& name, const LinkedList<int>&) { names.insertAtEnd(&name); });
+    std::sort(names.data(), names.data() + names.getSize(),
+              [](const std::string* a, const std::string* b) { return *a < *b; });
+    exportRounds(pool, names.getSize(), [&](int k, std::string& out) {
+        out += "CL ";
+        out += *names[k];
+        out += '\n';
+        renderCustomer(ets, *names[k], ets.customers.find(*names[k]), out);
+    }, file);
+
+    if (options.exportPackages) {
+        ArrayList<int> packageIds(static_cast<int>(ets.packages.size()));
+        ets.packages.forEach([&](const int& packageId, const PackageData&) { packageIds.insertAtEnd(packageId); });
+        std::sort(packageIds.data(), packageIds.data() + packageIds.getSize());
+        exportRounds(pool, packageIds.getSize(), [&](int k, std::string& out) {
+            out += "PC ";
+            appendPadded(out, packageIds[k], 3);
+            out += '\n';
+            renderPackage(ets, packageIds[k], ets.packages.find(packageIds[k]), out);
+        }, file);
+    }
+
+    file.close();
+    if (!file.fail()) return 0;
+    std::cerr << "Error: could not write export file: '" << options.exportPath << "'" << std::endl;
+    return 1;
+};
+
+
+
+/* Renders the items [0, count) in rounds of EXPORT_ROUND. Each worker renders a
+*  contiguous part of the round into its own buffer, and the buffers are written
+*  in the order of their parts, so the file is the same for any number of threads.
+*/
+void exportRounds(ThreadPool& pool, int count, const std::function<void(int, std::string&)>& render, std::ofstream& file) {
+    int parts = pool.getSize();
+    ArrayList<std::string> buffers(parts);
+    for (int part = 0; part < parts; part++) buffers.insertAtEnd(std::string());
+
+    for (int begin = 0; begin < count; begin += EXPORT_ROUND) {
+        int size = std::min(EXPORT_ROUND, count - begin);
+        pool.run(parts, [&](int part) {
+            std::string& buffer = buffers[part];
+            buffer.clear();
+            for (int k = begin + size * part / parts; k < begin + size * (part + 1) / parts; k++) render(k, buffer);
+        });
+        for (int part = 0; part < parts; part++) file.write(buffers[part].data(), buffers[part].size());
+    }
+};
+
+
+
+// Size of the customer thread followed by its events, read from the CSR rows when frozen
+void renderCustomer(const LogisticsSystem& ets, const std::string& customerName, const LinkedList<int>* customerPackages, std::string& body) {
+    appendInt(body, customerPackages->getSize());
+    body += '\n';
+
+    if (ets.frozenIndex.frozen) {
+        CsrSpan span = ets.frozenIndex.customers.find(customerName);
+        for (int k = 0; k < span.size; k++) {
+            ets.logs.render(span.items[k], body);
+            body += '\n';
+        }
+        return;
+    }
+
+    for (const DimensionNode<int>* DNode = customerPackages->head; DNode != nullptr; DNode = DNode->next(customerName)) {
+        ets.logs.render(DNode->item, body);
+        body += '\n';
+    }
+};
+
+
+
+
+void renderPackage(const LogisticsSystem& ets, int packageId, const PackageData* packageData, std::string& body) {
+    appendInt(body, packageData->events.getSize());
+    body += '\n';
+
+    if (ets.frozenIndex.frozen || packageData->spill.offset >= 0) {
+        CsrSpan span = ets.frozenIndex.frozen ? ets.frozenIndex.packages.find(packageId) : spilledSpan(ets, packageData);
+        for (int k = 0; k < span.size; k++) {
+            ets.logs.render(span.items[k], body);
+            body += '\n';
+        }
+        return;
+    }
+
+    for (const DimensionNode<int>* DNode = packageData->events.head; DNode != nullptr; DNode = DNode->next("package")) {
+        ets.logs.render(DNode->item, body);
+        body += '\n';
     }
 };
 
 
 
+/* Threads are chronological, so the window is reached walking back from the tail:
+*  only the events from the start of the window onwards are visited.
+*/
+void collectWindow(const EventColumns& columns, const DimensionNode<int>* tail, const std::string& dimension, int windowBegin, int windowEnd, ArrayList<int>& window) {
+    for (const DimensionNode<int>* DNode = tail; DNode != nullptr; DNode = DNode->prev(dimension)) {
+        int time = columns.time(DNode->item);
+        if (time < windowBegin) break;
+        if (time <= windowEnd) window.insertAtEnd(DNode->item);
+    }
 
-void handleActionPC(int time, std::ifstream& inputFile, ArrayList<std::string>& logs, Hash<int, PackageData>& packages, int i) {
-    int packageId;
+    // Collected from the newest to the oldest event
+    for (int low = 0, high = window.getSize() - 1; low < high; low++, high--) {
+        int item = window[low];
+        window[low] = window[high];
+        window[high] = item;
+    }
+};
 
-    inputFile >> packageId;
 
-    std::stringstream logStream;
-    logStream 
-        << std::setfill('0')
-        << std::setw(6) << time << " PC " 
-        << std::setw(3)<< packageId;
-    logs.insertAtEnd(logStream.str());
 
-    LinkedList<int>* packageEvents = &packages[packageId].events;
 
-    std::cout 
-        << logs[i] << std::endl
-        << packageEvents->getSize() << std::endl;
+void collectWindow(const EventColumns& columns, CsrSpan span, int windowBegin, int windowEnd, ArrayList<int>& window) {
+    int begin = columns.lowerBound(span.items, span.size, windowBegin);
+    int end = columns.upperBound(span.items, span.size, windowEnd);
+    for (int k = begin; k < end; k++)
+        window.insertAtEnd(span.items[k]);
+};
+
+
+
+
+void renderWindow(const LogisticsSystem& ets, const ArrayList<int>& window, std::string& body) {
+    appendInt(body, window.getSize());
+    body += '\n';
+    for (int k = 0; k < window.getSize(); k++) {
+        ets.logs.render(window[k], body);
+        body += '\n';
+    }
+};
+
+
+
+
+void handleActionFZ(LogisticsSystem& ets) {
+    freeze(ets.customers, ets.packages, ets.spillStore, ets.frozenIndex);
+    if (ets.replica.enabled()) publishReplica(ets);
+};
+
+
+
+// Publishes the frozen state (freezing it first) to the shared-memory region
+void publishReplica(LogisticsSystem& ets) {
+    freeze(ets.customers, ets.packages, ets.spillStore, ets.frozenIndex);
+    if (!ets.replica.publish(ets.logs, ets.frozenIndex.customers, ets.frozenIndex.packages))
+        std::cerr << "Error: could not publish the state to the shared memory region" << std::endl;
+};
+
+
+
+/* Replica mode: no ETS is built. The thread queries of the text file, and then
+*  those of the server clients, are answered from the region published by an
+*  ingest process, so any number of replicas share one copy of the state.
+*/
+int runReplica(TraceMerger& trace, const Options& options) {
+    ReplicaRegion replica;
+    if (!replica.attach(options.replicaName)) {
+        std::cerr << "Error: could not attach to shared memory region: '" << options.replicaName << "'" << std::endl;
+        return 1;
+    }
+
+    if (trace.getSize() > 0) {
+        std::string output;
+        OutputWriter writer(options.io);
+        Command command;
+        while (trace.next(command)) {
+            answerReplicaQuery(command, replica, output);
+            if (output.size() >= OUTPUT_FLUSH_BYTES) writer.write(output);
+        }
+        writer.write(output);
+    }
+    if (options.serverPath == nullptr) return 0;
+
+    return runServer(options.serverPath, [&](const UnixServer::Client&, const char* line, size_t length, std::string& out) {
+        Command command;
+        if (parseLine(line, length, command, out)) answerReplicaQuery(command, replica, out);
+    });
+};
+
+
+
+// Answers as the ETS would, retrying whenever a publication overlapped the read
+void answerReplicaQuery(const Command& command, ReplicaRegion& replica, std::string& out) {
+    if (!command.isThreadQuery()) {
+        out += "ERROR unsupported by a replica\n";
+        return;
+    }
 
-    if ( packageEvents->getSize() < 1) return;
-    else {
-        DimensionNode<int>* DNode = packageEvents->head;
-        do {
-            std::cout << logs[DNode->item] << std::endl;
-            DNode = DNode->dimension["package"].next;
-        } while (DNode != nullptr); 
+    std::string body;
+    bool rendered;
+    size_t sequence;
+    do {
+        sequence = replica.beginRead();
+        body.clear();
+        rendered = renderReplica(command, replica, body);
+    } while (!replica.endRead(sequence));
+
+    if (!rendered) {
+        out += "ERROR inconsistent replica\n";
+        return;
     }
+    EventLog::format(command, out);
+    out += '\n';
+    out += body;
 };
 
 
 
 
-void updateLists(int i, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int packageId, LinkedList<int>& DNodesList) {
+bool renderReplica(const Command& command, const ReplicaRegion& replica, std::string& body) {
+    bool customer = (command.type == CommandType::CL || command.type == CommandType::CW);
+    CsrSpan span = customer ? replica.customerRow(command.customerName) : replica.packageRow(command.packageId);
+    bool windowed = (command.type == CommandType::CW || command.type == CommandType::PW);
+    if (windowed && !replica.window(span, command.windowBegin, command.windowEnd)) return false;
+
+    appendInt(body, span.size);
+    body += '\n';
+    Command event;
+    for (int k = 0; k < span.size; k++) {
+        if (!replica.command(span.items[k], event)) return false;
+        EventLog::format(event, body);
+        body += '\n';
+    }
+    return true;
+};
+
+
+
+
+void handleActionAG(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+    printTypeCounts(ets, command.windowBegin, command.windowEnd, -1, out);
+};
+
+
+
+
+void handleActionWT(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+    printTypeCounts(ets, command.windowBegin, command.windowEnd, command.warehouseId, out);
+};
+
+
+
+// One line per event type: its code and how many events of it fall in [windowBegin, windowEnd]
+void printTypeCounts(const LogisticsSystem& ets, int windowBegin, int windowEnd, int warehouse, std::string& out) {
+    int counts[EVENT_TYPE_COUNT];
+    int begin = ets.columns.lowerBound(windowBegin);
+    int end = ets.columns.upperBound(windowEnd);
+    ets.columns.countByType(begin, end, warehouse, counts);
+
+    const char* codes[EVENT_TYPE_COUNT] = { "RG", "AR", "RM", "UR", "TR", "EN" };
+    for (int k = 0; k < EVENT_TYPE_COUNT; k++) {
+        out += codes[k];
+        out += ' ';
+        appendInt(out, counts[k]);
+        out += '\n';
+    }
+};
+
+
+
+
+void handleActionWP(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+    printLocationList(ets, ets.warehouses.find(command.warehouseId), WAREHOUSE_DIMENSION, out);
+};
+
+
+
+
+void handleActionSP(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+    printLocationList(ets, ets.sections.find(sectionKey(command.warehouseId, command.targetSection)), SECTION_DIMENSION, out);
+};
+
+
+
+void handleActionTC(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+
+    ArrayList<int> handles(0);
+    ets.customerRanks.top(command.limit, handles);
+    appendInt(out, handles.getSize());
+    out += '\n';
+    for (int k = 0; k < handles.getSize(); k++) {
+        out += ets.customerRanks.key(handles[k]);
+        out += ' ';
+        appendInt(out, ets.customerRanks.count(handles[k]));
+        out += '\n';
+    }
+};
+
+
+
+
+void handleActionTP(const Command& command, LogisticsSystem& ets, int i, std::string& out) {
+    ets.logs.render(i, out);
+    out += '\n';
+
+    ArrayList<int> handles(0);
+    ets.packageRanks.top(command.limit, handles);
+    appendInt(out, handles.getSize());
+    out += '\n';
+    for (int k = 0; k < handles.getSize(); k++) {
+        appendPadded(out, ets.packageRanks.key(handles[k]), 3);
+        out += ' ';
+        appendInt(out, ets.packageRanks.count(handles[k]));
+        out += '\n';
+    }
+};
+
+
+
+/* Every event counts for its package. A package counts for its stakeholders from
+*  its registration (or, for the ones added by ST, from then) until its delivery.
+*/
+void updateRanks(const Command& command, LogisticsSystem& ets, PackageData* packageData) {
+    if (packageData->rank < 0) packageData->rank = ets.packageRanks.handle(command.packageId);
+    ets.packageRanks.add(packageData->rank, 1);
+
+    ArrayList<Stakeholder>& stakeholders = packageData->stakeholders;
+    int delta = 0;
+    if (command.type == CommandType::RG && !packageData->active) delta = 1;
+    else if (command.type == CommandType::EN && packageData->active) delta = -1;
+
+    if (delta != 0) {
+        packageData->active = (delta > 0);
+        for (int k = 0; k < stakeholders.getSize(); k++) {
+            if (stakeholders[k].rank < 0) stakeholders[k].rank = ets.customerRanks.handle(stakeholders[k].name);
+            ets.customerRanks.add(stakeholders[k].rank, delta);
+        }
+    } else if (command.type == CommandType::ST && packageData->active) {
+        // Only a stakeholder this very event added starts at the tail
+        Stakeholder& last = stakeholders[stakeholders.getSize() - 1];
+        if (last.first == packageData->events.tail && last.name == command.customerName) {
+            last.rank = ets.customerRanks.handle(last.name);
+            ets.customerRanks.add(last.rank, 1);
+        }
+    }
+};
+
+
+
+// Prints the size of the location list and the last event of each package in it
+void printLocationList(const LogisticsSystem& ets, const LinkedList<int>* locationList, const std::string& dimension, std::string& out) {
+    if (locationList == nullptr || locationList->getSize() < 1) {
+        out += "0\n";
+        return;
+    }
+
+    appendInt(out, locationList->getSize());
+    out += '\n';
+    DimensionNode<int>* DNode = locationList->head;
+    do {
+        const PackageData* packageData = ets.packages.find(DNode->item);
+        ets.logs.render(packageData->events.tail->item, out);
+        out += '\n';
+        DNode = DNode->next(dimension);
+    } while (DNode != nullptr);
+};
+
+
+
+
+void freeze(Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, const SpillStore& spillStore, FrozenIndex& frozenIndex) {
+    if (frozenIndex.frozen) return;
+
+    // Sizes the CSR arrays once, from the sizes already kept by each thread
+    int customerItems = 0;
+    customers.forEach([&](const std::string&, const LinkedList<int>& list) {
+        customerItems += list.getSize();
+    });
+    int packageItems = 0;
+    packages.forEach([&](const int&, const PackageData& packageData) {
+        packageItems += packageData.events.getSize();
+    });
+    frozenIndex.customers.reserve(customers.size(), customerItems);
+    frozenIndex.packages.reserve(packages.size(), packageItems);
+
+    // Each thread is copied in its own order, which is already chronological
+    customers.forEach([&](const std::string& customer, const LinkedList<int>& list) {
+        frozenIndex.customers.beginRow(customer);
+        for (DimensionNode<int>* DNode = list.head; DNode != nullptr; DNode = DNode->next(customer))
+            frozenIndex.customers.append(DNode->item);
+    });
+    packages.forEach([&](const int& packageId, const PackageData& packageData) {
+        frozenIndex.packages.beginRow(packageId);
+        if (packageData.spill.offset >= 0) {
+            const int* items = spillStore.items(packageData.spill);
+            for (int k = 0; k < packageData.spill.size; k++)
+                frozenIndex.packages.append(items[k]);
+            return;
+        }
+        for (DimensionNode<int>* DNode = packageData.events.head; DNode != nullptr; DNode = DNode->next("package"))
+            frozenIndex.packages.append(DNode->item);
+    });
+
+    frozenIndex.frozen = true;
+};
+
+
+
+
+void thaw(FrozenIndex& frozenIndex) {
+    if (!frozenIndex.frozen) return;
+
+    frozenIndex.customers.clear();
+    frozenIndex.packages.clear();
+    frozenIndex.frozen = false;
+};
+
+
+
+
+// Returns the package, so the callers do not look it up again
+PackageData* updateLists(int i, Hash<std::string, LinkedList<int>>& customers, Hash<int, PackageData>& packages, int packageId, size_t packageHash, NodePool<int>& nodes, PerfProfiler& profiler) {
     // Package List
-    PackageData* packageData = &packages[packageId];
+    PackageData* packageData = &packages.get(packageId, packageHash);
     // Last event
     DimensionNode<int>* DNode = packageData->events.tail;
     // New event
-    DimensionNode<int>* newDNode = new DimensionNode<int>;
+    DimensionNode<int>* newDNode = nodes.allocate();
     newDNode->item = i;
-    
-    updateDeleteList(DNodesList, newDNode);
 
-    updateCustomerList(packageData->sender, DNode, newDNode, packageData->events.getSize(), &customers[packageData->sender]);
-    
-    updateCustomerList(packageData->recipient, DNode, newDNode, packageData->events.getSize(), &customers[packageData->recipient]);
+    // Every stakeholder gets the same replace-last update, whatever their number
+    for (int k = 0; k < packageData->stakeholders.getSize(); k++) {
+        const Stakeholder& stakeholder = packageData->stakeholders[k];
+        ProfileScope scope(profiler, PROFILE_UPDATE_CUSTOMER_LIST);
+        updateCustomerList(stakeholder.name, stakeholder.hash, DNode, newDNode, stakeholder.first, &customers.get(stakeholder.name, stakeholder.hash));
+    }
     
-    updatePackageList(packageData, newDNode);
+    ProfileScope scope(profiler, PROFILE_UPDATE_PACKAGE_LIST);
+    updatePackageList(&packageData->events, newDNode);
+    return packageData;
 };
 
 
 
 
-void updateCustomerList(std::string customer, DimensionNode<int>* DNode, DimensionNode<int>* newDNode, int packageListEventPosition, LinkedList<int>* customerList) {    
-    if (customerList->tail == nullptr) { // Customer list is empty
-        // Add newDNode as the 1st element of the list
-        customerList->head = newDNode;
-        customerList->size = 1;
-    } else if (packageListEventPosition <= 1) { // 1st or 2nd event of a package
-        // As the 1st event cannot be deleted, in both conditions the new event is added to the end of the list
-        customerList->tail->dimension[customer].next = newDNode;
-        newDNode->dimension[customer].prev = customerList->tail;
-        customerList->size++;
-    } else {
-        if (DNode->dimension[customer].next == nullptr) {
-            // The new DNode replaces the old one
-            customerList->tail->dimension[customer].prev->dimension[customer].next = newDNode;
-            newDNode->dimension[customer].prev = customerList->tail->dimension[customer].prev;
-        } else { // Has a subsequent DNode
-            // It is necessary to delete the old DNode from the list and add the new one at the end;
-            DNode->dimension[customer].prev->dimension[customer].next = DNode->dimension[customer].next;
-            DNode->dimension[customer].next->dimension[customer].prev = DNode->dimension[customer].prev;
-            customerList->tail->dimension[customer].next = newDNode;
-            newDNode->dimension[customer].prev = customerList->tail; 
-        }
+/* Moves the location node of the package to its new warehouse and section.
+*  Being doubly linked, the node leaves its current lists and joins the new ones in
+*  constant time; a negative warehouse or section means the package is out of them,
+*  and a package out of every warehouse is out of every section as well.
+*/
+void updateLocation(LogisticsSystem& ets, PackageData* packageData, int packageId, int warehouse, int section) {
+    ProfileScope scope(ets.profiler, PROFILE_UPDATE_LOCATION);
+    if (warehouse < 0) section = -1;
+
+    if (packageData->location == nullptr) {
+        packageData->location = ets.nodes.allocate();
+        packageData->location->item = packageId;
+    }
+    DimensionNode<int>* location = packageData->location;
+
+    if (packageData->warehouse != warehouse) {
+        if (packageData->warehouse >= 0)
+            unlinkNode(&ets.warehouses[packageData->warehouse], location, WAREHOUSE_DIMENSION);
+        if (warehouse >= 0)
+            appendNode(&ets.warehouses[warehouse], location, WAREHOUSE_DIMENSION);
+    }
+
+    if (packageData->warehouse != warehouse || packageData->section != section) {
+        if (packageData->section >= 0)
+            unlinkNode(&ets.sections[sectionKey(packageData->warehouse, packageData->section)], location, SECTION_DIMENSION);
+        if (section >= 0)
+            appendNode(&ets.sections[sectionKey(warehouse, section)], location, SECTION_DIMENSION);
     }
-    customerList->tail = newDNode;
+
+    packageData->warehouse = warehouse;
+    packageData->section = section;
 };
 
 
 
 
-void updateDeleteList(LinkedList<int>& DNodesList, DimensionNode<int>* newDNode) {
-    // Add as last element
-    DNodesList.tail->dimension["delete"].next = newDNode;
-    newDNode->dimension["delete"].prev = DNodesList.tail;
-    DNodesList.tail = newDNode;
-    DNodesList.size++;
+void unlinkNode(LinkedList<int>* list, DimensionNode<int>* DNode, const std::string& dimension) {
+    DimensionPointers<int>& pointers = DNode->dimension[dimension];
+
+    if (pointers.prev != nullptr) pointers.prev->dimension[dimension].next = pointers.next;
+    else list->head = pointers.next;
+
+    if (pointers.next != nullptr) pointers.next->dimension[dimension].prev = pointers.prev;
+    else list->tail = pointers.prev;
+
+    pointers.prev = nullptr;
+    pointers.next = nullptr;
+    list->size--;
 };
 
 
 
 
-void updatePackageList(PackageData* packageData, DimensionNode<int>* newDNode) {
-    if (packageData->events.getSize() == 0) {
-        // Add as 1st element
-        packageData->events.head = newDNode;
-        packageData->events.tail = packageData->events.head;
-        packageData->events.size = 1;
+void appendNode(LinkedList<int>* list, DimensionNode<int>* DNode, const std::string& dimension) {
+    if (list->tail == nullptr) {
+        list->head = DNode;
     } else {
-        // Add as last element
-        packageData->events.tail->dimension["package"].next = newDNode;
-        newDNode->dimension["package"].prev = packageData->events.tail;
-        packageData->events.tail = newDNode;
-        packageData->events.size++;
+        list->tail->dimension[dimension].next = DNode;
+        DNode->dimension[dimension].prev = list->tail;
+    }
+    list->tail = DNode;
+    list->size++;
+};
+
+
+
+// Sections are numbered inside each warehouse, so both ids form the key
+size_t sectionKey(int warehouse, int section) {
+    return (static_cast<size_t>(static_cast<unsigned int>(warehouse)) << 32) | static_cast<unsigned int>(section);
+};
+
+
+
+
+// Moves the location node of the package to the end of the "recent" dimension
+void touchPackage(LogisticsSystem& ets, int packageId) {
+    DimensionNode<int>* location = ets.packages[packageId].location;
+    // A package only known from ST events has no location yet
+    if (location == nullptr || ets.recent.tail == location) return;
+
+    if (ets.recent.head == location || location->prev("recent") != nullptr)
+        unlinkNode(&ets.recent, location, "recent");
+    appendNode(&ets.recent, location, "recent");
+};
+
+
+
+/* The "recent" dimension is ordered by the last event of each package, so the cold
+*  packages are always at its head: they are spilled until the first one touched
+*  within the window. A spilled package leaves the dimension until its next event.
+*/
+void spillColdPackages(LogisticsSystem& ets, int now) {
+    while (ets.recent.head != nullptr) {
+        DimensionNode<int>* location = ets.recent.head;
+        PackageData* packageData = &ets.packages[location->item];
+        if (now - ets.columns.time(packageData->events.tail->item) <= ets.spillWindow) break;
+
+        unlinkNode(&ets.recent, location, "recent");
+        spillPackage(ets, packageData);
+    }
+};
+
+
+
+/* Writes the whole package thread to the spill store and frees its middle nodes.
+*  The first and last nodes stay, linked to each other, since they are the only
+*  ones the customer threads can point to; the size of the thread is kept as well.
+*  A package with stakeholders added by ST stays in memory, as their threads start
+*  at a middle node.
+*/
+void spillPackage(LogisticsSystem& ets, PackageData* packageData) {
+    LinkedList<int>& events = packageData->events;
+    if (events.getSize() <= 2 || packageData->spill.offset >= 0) return;
+    for (int k = 0; k < packageData->stakeholders.getSize(); k++)
+        if (packageData->stakeholders[k].first != events.head) return;
+
+    ArrayList<int> items(events.getSize());
+    for (DimensionNode<int>* DNode = events.head; DNode != nullptr; DNode = DNode->next("package"))
+        items.insertAtEnd(DNode->item);
+
+    SpillSpan span = ets.spillStore.write(items.data(), items.getSize());
+    // Without room in the file, the package just stays in memory
+    if (span.offset < 0) return;
+
+    DimensionNode<int>* DNode = events.head->next("package");
+    while (DNode != events.tail) {
+        DimensionNode<int>* next = DNode->next("package");
+        ets.nodes.release(DNode);
+        DNode = next;
+    }
+    events.head->dimension["package"].next = events.tail;
+    events.tail->dimension["package"].prev = events.head;
+    packageData->spill = span;
+};
+
+
+
+// Rebuilds the middle nodes of a spilled package thread before it receives an event
+void restorePackage(LogisticsSystem& ets, int packageId) {
+    const PackageData* found = ets.packages.find(packageId);
+    if (found == nullptr || found->spill.offset < 0) return;
+
+    PackageData* packageData = &ets.packages[packageId];
+    LinkedList<int>& events = packageData->events;
+    const int* items = ets.spillStore.items(packageData->spill);
+
+    DimensionNode<int>* DNode = events.head;
+    for (int k = 1; k < packageData->spill.size - 1; k++) {
+        DimensionNode<int>* newDNode = ets.nodes.allocate();
+        newDNode->item = items[k];
+        DNode->dimension["package"].next = newDNode;
+        newDNode->dimension["package"].prev = DNode;
+        DNode = newDNode;
+    }
+    DNode->dimension["package"].next = events.tail;
+    events.tail->dimension["package"].prev = DNode;
+    packageData->spill = SpillSpan();
+};
+
+
+
+
+CsrSpan spilledSpan(const LogisticsSystem& ets, const PackageData* packageData) {
+    CsrSpan span;
+    span.items = ets.spillStore.items(packageData->spill);
+    span.size = packageData->spill.size;
+    return span;
+};
+
+
+
+
+size_t heapBytes(const Stakeholder& stakeholder) {
+    return heapBytes(stakeholder.name);
+};
+
+
+
+
+size_t heapBytes(const PackageData& packageData) {
+    return packageData.stakeholders.memoryUsage().bytes;
+};
+
+
+
+// Heap bytes of every structure of the ETS, optionally printed as a table to stderr
+MemoryUsage measureMemory(const LogisticsSystem& ets, bool report) {
+    const int STRUCTURE_COUNT = 10;
+    const char* names[STRUCTURE_COUNT] = {
+        "logs", "columns", "customers", "packages", "warehouses",
+        "sections", "nodes", "frozen index", "query caches", "rankings"
+    };
+    MemoryUsage usages[STRUCTURE_COUNT];
+    usages[0] = ets.logs.memoryUsage();
+    usages[1] = ets.columns.memoryUsage();
+    usages[2] = ets.customers.memoryUsage();
+    usages[3] = ets.packages.memoryUsage();
+    usages[4] = ets.warehouses.memoryUsage();
+    usages[5] = ets.sections.memoryUsage();
+    usages[6] = ets.nodes.memoryUsage();
+    usages[7] = ets.frozenIndex.customers.memoryUsage();
+    usages[7] += ets.frozenIndex.packages.memoryUsage();
+    usages[8] = ets.customerCache.memoryUsage();
+    usages[8] += ets.packageCache.memoryUsage();
+    usages[9] = ets.customerRanks.memoryUsage();
+    usages[9] += ets.packageRanks.memoryUsage();
+
+    MemoryUsage total;
+    for (int k = 0; k < STRUCTURE_COUNT; k++) total += usages[k];
+    if (!report) return total;
+
+    std::cerr << std::left << std::setw(14) << "structure" << std::right 
+              << std::setw(14) << "bytes" << std::setw(14) << "in use" << std::setw(8) << "slack" << '\n';
+    for (int k = 0; k <= STRUCTURE_COUNT; k++) {
+        const MemoryUsage& usage = (k < STRUCTURE_COUNT) ? usages[k] : total;
+        double slack = (usage.bytes > 0) ? 100.0 * (usage.bytes - usage.usedBytes) / usage.bytes : 0.0;
+        std::cerr << std::left << std::setw(14) << ((k < STRUCTURE_COUNT) ? names[k] : "total") << std::right 
+                  << std::setw(14) << usage.bytes << std::setw(14) << usage.usedBytes 
+                  << std::setw(7) << std::fixed << std::setprecision(1) << slack << "%\n";
     }
-};
\ No newline at end of file
+    std::cerr << "nodes handed out: " << ets.nodes.getSize() << ", spare: " << ets.nodes.getSpare() << '\n';
+    if (ets.spillStore.enabled())
+        std::cerr << "spill file (mapped, not in total): " << ets.spillStore.getSize() * sizeof(int) << " bytes\n";
+    return total;
+};
+
+
+
+/* Memory is given back in order of cost: cached answers and the frozen index are
+*  dropped (queries fall back to the live threads), every thread that can be
+*  spilled is spilled, and the arrays and tables are shrunk to their contents.
+*  Returns false if the usage is still above the budget after all of that.
+*/
+bool enforceBudget(LogisticsSystem& ets, size_t budget) {
+    if (measureMemory(ets, false).bytes <= budget) return true;
+
+    ets.customerCache.clear();
+    ets.packageCache.clear();
+    thaw(ets.frozenIndex);
+    if (ets.spillStore.enabled()) spillColdPackages(ets, INT_MAX);
+    shrinkToFit(ets);
+
+    return measureMemory(ets, false).bytes <= budget;
+};
+
+
+
+
+void shrinkToFit(LogisticsSystem& ets) {
+    ets.logs.shrinkToFit();
+    ets.columns.shrinkToFit();
+    ets.customers.shrinkToFit();
+    ets.packages.shrinkToFit();
+    ets.warehouses.shrinkToFit();
+    ets.sections.shrinkToFit();
+};
+
+
+
+
+// Per-call averages of every region that ran, and the IPC when the counters were available
+void printProfile(const PerfProfiler& profiler) {
+    const char* names[PROFILE_REGIONS] = {
+        "UNKNOWN", "CL", "PC", "CW", "PW", "FZ", "AG", "WT", "WP", "SP",
+        "RG", "AR", "RM", "UR", "TR", "EN", "ST", "TC", "TP",
+        "recordCommand", "updateLists", "updateCustomerList", "updatePackageList", "updateLocation", "query batch"
+    };
+
+    std::cerr << std::left << std::setw(20) << "region" << std::right << std::setw(10) << "calls"
+              << std::setw(12) << "ns/call" << std::setw(12) << "cycles" << std::setw(12) << "instr"
+              << std::setw(7) << "IPC" << std::setw(10) << "LLC miss" << std::setw(10) << "br miss" << '\n';
+    for (int region = 0; region < profiler.getSize(); region++) {
+        const ProfileTotals& totals = profiler.totals(region);
+        if (totals.calls == 0) continue;
+
+        std::cerr << std::left << std::setw(20) << names[region] << std::right << std::setw(10) << totals.calls
+                  << std::setw(12) << totals.nanoseconds / totals.calls;
+        // Blank when no call of the region ran on a thread with counters
+        if (totals.countedCalls == 0) {
+            std::cerr << std::setw(12) << '-' << std::setw(12) << '-' << std::setw(7) << '-'
+                      << std::setw(10) << '-' << std::setw(10) << '-' << '\n';
+            continue;
+        }
+        double ipc = (totals.counters[0] > 0) ? static_cast<double>(totals.counters[1]) / totals.counters[0] : 0.0;
+        std::cerr << std::setw(12) << totals.counters[0] / totals.countedCalls << std::setw(12) << totals.counters[1] / totals.countedCalls
+                  << std::setw(7) << std::fixed << std::setprecision(2) << ipc
+                  << std::setw(10) << std::setprecision(2) << static_cast<double>(totals.counters[2]) / totals.countedCalls
+                  << std::setw(10) << static_cast<double>(totals.counters[3]) / totals.countedCalls << '\n';
+    }
+};
+
+
+
+
+// Queue depth and query latency of the scheduled server mode
+void printSchedulerMetrics(const SchedulerMetrics& metrics, int latencyTarget) {
+    long queries = metrics.directQueries + metrics.queuedQueries;
+    std::cerr << "lines applied by the event thread: " << metrics.applied
+              << ", turns given up to queries: " << metrics.yields << '\n';
+    std::cerr << "queue depth: max " << metrics.depthMax << ", mean " << std::fixed << std::setprecision(1)
+              << ((metrics.depthSamples > 0) ? static_cast<double>(metrics.depthTotal) / metrics.depthSamples : 0.0) << '\n';
+    std::cerr << "queries: " << queries << " (" << metrics.directQueries << " ahead of the queue, "
+              << metrics.queuedQueries << " queued behind their own lines)\n";
+    if (queries == 0) return;
+    std::cerr << "query latency: mean " << metrics.latencyTotal / queries / 1000 << " us, max "
+              << metrics.latencyMax / 1000 << " us, " << metrics.overTarget << " over the target of "
+              << latencyTarget << " us\n";
+};